@@ -7,9 +7,7 @@
 #include "system_fade.hpp"
 #include "basic_animations.hpp"
 
-#if USE_GLES32
 #include "fire.hpp"
-#endif
 
 void animation_base::init(wayfire_view, int, bool) {}
 bool animation_base::step() {return false;}
@@ -49,7 +47,7 @@ struct animation_hook
     bool effect_running = true;
     bool first_run = true;
 
-    animation_hook(wayfire_grab_interface ifc, wayfire_view view, int frame_count) :
+    animation_hook(wayfire_grab_interface ifc, wayfire_view view, int duration) :
         iface(ifc)
     {
         this->view = view;
@@ -78,7 +76,7 @@ struct animation_hook
             if (first_run)
             {
                 base = static_cast<animation_base*> (new animation_type());
-                base->init(view, frame_count, close_animation);
+                base->init(view, duration, close_animation);
                 first_run = false;
             }
 
@@ -139,7 +137,7 @@ class wayfire_animation : public wayfire_plugin_t {
     signal_callback_t create_cb, destroy_cb, wake_cb;
 
     std::string open_animation, close_animation;
-    int frame_count;
+    int duration;
     int startup_duration;
 
     public:
@@ -151,18 +149,8 @@ class wayfire_animation : public wayfire_plugin_t {
         auto section = config->get_section("animate");
         open_animation = section->get_string("open_animation", "fade");
         close_animation = section->get_string("close_animation", "fade");
-        frame_count = section->get_duration("duration", 16);
-        startup_duration = section->get_duration("startup_duration", 36);
-
-#if not USE_GLES32
-        if(open_animation == "fire" || close_animation == "fire")
-        {
-            errio << "[EE] OpenGL ES version below 3.2," <<
-                " so no support for Fire effect" <<
-                "defaulting to fade effect" << std::endl;
-            open_animation = close_animation = "fade";
-        }
-#endif
+        duration = section->get_duration("duration", 256);
+        startup_duration = section->get_duration("startup_duration", 576);
 
         using namespace std::placeholders;
         create_cb = std::bind(std::mem_fn(&wayfire_animation::view_created),
@@ -196,13 +184,11 @@ class wayfire_animation : public wayfire_plugin_t {
             data->created_view->surface->ref_count++;
 
         if (open_animation == "fade")
-            new animation_hook<fade_animation, false>(grab_interface, data->created_view, frame_count);
+            new animation_hook<fade_animation, false>(grab_interface, data->created_view, duration);
         else if (open_animation == "zoom")
-            new animation_hook<zoom_animation, false>(grab_interface, data->created_view, frame_count);
-#if USE_GLES32
+            new animation_hook<zoom_animation, false>(grab_interface, data->created_view, duration);
         else if (open_animation == "fire")
-            new animation_hook<wf_fire_effect, false>(grab_interface, data->created_view, frame_count);
-#endif
+            new animation_hook<wf_fire_effect, false>(grab_interface, data->created_view, duration);
     }
 
     void view_destroyed(signal_data *ddata)
@@ -215,13 +201,11 @@ class wayfire_animation : public wayfire_plugin_t {
             return;
 
         if (close_animation == "fade")
-            new animation_hook<fade_animation, true> (grab_interface, data->destroyed_view, frame_count);
+            new animation_hook<fade_animation, true> (grab_interface, data->destroyed_view, duration);
         else if (close_animation == "zoom")
-            new animation_hook<zoom_animation, true> (grab_interface, data->destroyed_view, frame_count);
-#if USE_GLES32
+            new animation_hook<zoom_animation, true> (grab_interface, data->destroyed_view, duration);
         else if (close_animation == "fire")
-            new animation_hook<wf_fire_effect, true> (grab_interface, data->destroyed_view, frame_count);
-#endif
+            new animation_hook<wf_fire_effect, true> (grab_interface, data->destroyed_view, duration);
     }
 
     void fini()
@@ -2,11 +2,12 @@
 #define ANIMATE_H_
 
 #include <view.hpp>
+#include <animation.hpp>
 
 class animation_base
 {
     public:
-    virtual void init(wayfire_view view, int frame_count, bool close);
+    virtual void init(wayfire_view view, int duration, bool close);
     virtual bool step(); /* return true if continue, false otherwise */
     virtual ~animation_base();
 };
@@ -6,29 +6,29 @@ class fade_animation : public animation_base
 {
     wayfire_view view;
 
-    float start = 0, end = 1;
-    int total_frames, current_frame;
+    wf_transition alpha = {0, 1};
+    wf_duration duration;
 
     public:
 
-    void init(wayfire_view view, int tf, bool close)
+    void init(wayfire_view view, int dur, bool close)
     {
         this->view = view;
-        total_frames = tf;
-        current_frame = 0;
+        duration = wf_duration(view->output, dur);
+        duration.start();
 
         if (close)
-            std::swap(start, end);
+            std::swap(alpha.start, alpha.end);
 
     }
 
     bool step()
     {
-        view->transform.color[3] = GetProgress(start, end, current_frame, total_frames);
+        view->transform.color[3] = duration.progress(alpha);
         view->simple_render(TEXTURE_TRANSFORM_USE_DEVCOORD);
         view->transform.color[3] = 0.0f;
 
-        return current_frame++ < total_frames;
+        return duration.running();
     }
 
     ~fade_animation()
@@ -41,31 +41,30 @@ class zoom_animation : public animation_base
 {
     wayfire_view view;
 
-    float alpha_start = 0, alpha_end = 1;
-    float zoom_start = 1./3, zoom_end = 1;
-    int total_frames, current_frame;
+    wf_transition alpha = {0, 1}, zoom = {1./3, 1};
+    wf_duration duration;
 
     public:
 
-    void init(wayfire_view view, int tf, bool close)
+    void init(wayfire_view view, int dur, bool close)
     {
         this->view = view;
-        total_frames = tf;
-        current_frame = 0;
+        duration = wf_duration(view->output, dur);
+        duration.start();
 
         if (close)
         {
-            std::swap(alpha_start, alpha_end);
-            std::swap(zoom_start, zoom_end);
+            std::swap(alpha.start, alpha.end);
+            std::swap(zoom.start, zoom.end);
         }
 
     }
 
     bool step()
     {
-        view->transform.color[3] = GetProgress(alpha_start, alpha_end, current_frame, total_frames);
+        view->transform.color[3] = duration.progress(alpha);
 
-        float c = GetProgress(zoom_start, zoom_end, current_frame, total_frames);
+        float c = duration.progress(zoom);
 
         auto og = view->output->get_full_geometry();
 
@@ -90,7 +89,7 @@ class zoom_animation : public animation_base
 
         view->geometry = compositor_geometry;
 
-        return current_frame++ < total_frames;
+        return duration.running();
     }
 
     ~zoom_animation()
@@ -1,10 +1,12 @@
 #include <opengl.hpp>
 #include <cmath>
+#include <algorithm>
 #include "fire.hpp"
 #include <signal-definitions.hpp>
 #include <chrono>
 #include <config.h>
 #include <render-manager.hpp>
+#include <core.hpp>
 
 #define MAX_PARTICLES (512)
 #define MIN_PARTICLE_SIZE 0.09
@@ -19,14 +21,82 @@ unsigned char data[256 * 256];
 GLuint rand_tex;
 bool data_filled = false;
 
+static void init_noise_data()
+{
+    if (data_filled)
+        return;
+
+    std::srand(time(0));
+    for (int i = 0; i < 256 * 256; i++)
+    {
+        data[i] = std::rand() % 256;
+    }
+
+    data_filled = true;
+}
+
+/* CPU versions of the helpers in fire_compute.glsl */
+static float fract(float x)
+{
+    return x - std::floor(x);
+}
+
+static float glsl_rand(float x, float y)
+{
+    return fract(std::sin(x * 12.9898f + y * 78.233f) * 43758.5453f);
+}
+
+/* texture(img, vec2(u, v)).r with linear filtering and repeat wrapping */
+static float sample_noise(float u, float v)
+{
+    float tx = u * 256.0f - 0.5f, ty = v * 256.0f - 0.5f;
+    float fx = std::floor(tx), fy = std::floor(ty);
+
+    int x0 = int(fx) & 255, y0 = int(fy) & 255;
+    int x1 = (x0 + 1) & 255, y1 = (y0 + 1) & 255;
+    fx = tx - fx;
+    fy = ty - fy;
+
+    float top = data[y0 * 256 + x0] * (1 - fx) + data[y0 * 256 + x1] * fx;
+    float bot = data[y1 * 256 + x0] * (1 - fx) + data[y1 * 256 + x1] * fx;
+
+    return (top * (1 - fy) + bot * fy) / 255.0f;
+}
+
+static float noise3D(float x, float y, float z)
+{
+    z = fract(z) * 256.0f;
+    float iz = std::floor(z);
+    float fz = z - iz;
+
+    float a = sample_noise(x + 23.0f * iz / 256.0f, y + 29.0f * iz / 256.0f);
+    float b = sample_noise(x + 23.0f * (iz + 1) / 256.0f, y + 29.0f * (iz + 1) / 256.0f);
+    return a * (1 - fz) + b * fz;
+}
+
+static float perlin_noise3D(float x, float y, float z)
+{
+    /* the shader swaps x and z */
+    std::swap(x, z);
+
+    float result = 0, scale = 1, weight = 1;
+    for (int i = 0; i < 6; i++)
+    {
+        result += noise3D(x * scale, y * scale, z * scale) * weight;
+        scale *= 2;
+        weight *= 0.5;
+    }
+
+    return result;
+}
+
 class fire_particle_system : public wf_particle_system
 {
     float _cx, _cy;
     float _w, _h;
 
-    float global_dx, global_dy;
-
     float gravity;
+    float noise_time;
 
     int effect_cycles;
 
@@ -34,6 +104,15 @@ class fire_particle_system : public wf_particle_system
 
     void load_compute_program()
     {
+#if USE_GLES32
+        /* compiled only once, like the programs of the base class */
+        static GLuint program = 0;
+        if (program)
+        {
+            computeProg = program;
+            return;
+        }
+
         std::string shaderSrcPath = INSTALL_PREFIX"/share/wayfire/animate/shaders";
 
         computeProg = GL_CALL(glCreateProgram());
@@ -44,20 +123,10 @@ class fire_particle_system : public wf_particle_system
 
         GL_CALL(glAttachShader(computeProg, css));
         GL_CALL(glLinkProgram(computeProg));
-        GL_CALL(glUseProgram(computeProg));
-
-        GL_CALL(glUniform1i(1, particleLife));
-        GL_CALL(glUniform1f(5, 2 * _w));
-        GL_CALL(glUniform1f(6, 2 * _h));
+        program = computeProg;
 
-        if (!data_filled)
+        if (!rand_tex)
         {
-            std::srand(time(0));
-            for (int i = 0; i < 256 * 256; i++)
-            {
-                data[i] = std::rand() % 256;
-            }
-
             GL_CALL(glGenTextures(1, &rand_tex));
             GL_CALL(glBindTexture(GL_TEXTURE_2D, rand_tex));
             GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
@@ -66,28 +135,27 @@ class fire_particle_system : public wf_particle_system
             GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS, 0));
 
             GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, 256, 256, 0, GL_RED, GL_UNSIGNED_BYTE, data));
-
-            data_filled = true;
         }
+#endif
     }
 
     void gen_base_mesh()
     {
         wf_particle_system::gen_base_mesh();
 
-        global_dx = global_dy = 0;
+        globalOffset = {0, 0};
         add_offset(_cx - _w, _cy - _h);
     }
 
-    void default_particle_initer(particle_t &p)
+    void default_particle_initer(particle_t &p, std::minstd_rand& rng)
     {
         p.life = 0;
 
-        p.dy = 2. * _h * float(std::rand() % 50 + 951) / (950. * effect_cycles);
+        p.dy = 2. * _h * float(rng() % 50 + 951) / (950. * effect_cycles);
         p.dx = 0;
 
-        p.x = (float(std::rand() % 1001) / 1000.0) * _w * 2.;
-        p.y = (float(std::rand() % 1001) / 1000.0) * _h * 0.02;
+        p.x = (float(rng() % 1001) / 1000.0) * _w * 2.;
+        p.y = (float(rng() % 1001) / 1000.0) * _h * 0.02;
     }
 
     fire_particle_system(float cx, float cy, float w, float h, int numParticles,
@@ -105,12 +173,16 @@ class fire_particle_system : public wf_particle_system
         particleLife    = maxLife;
         respawnInterval = 1;
 
+        init_noise_data();
         init_gles_part();
         set_particle_color(glm::vec4(0.4, 0.17, 0.05, 0.3 + w * 0.1), glm::vec4(0.4, 0.17, 0.05, 0.3));
 
-        GL_CALL(glUseProgram(renderProg));
-        GL_CALL(glUniform1f(4, particleSize * 0.8));
-        GL_CALL(glUseProgram(0));
+        particleRadius = particleSize * 0.8;
+    }
+
+    int iteration()
+    {
+        return currentIteration;
     }
 
     int check()
@@ -122,14 +194,21 @@ class fire_particle_system : public wf_particle_system
     }
 
     void simulate()
-   {
-        GL_CALL(glUseProgram(computeProg));
-        GL_CALL(glUniform1f(7, gravity));
-        GL_CALL(glUniform1f(8, 0.5 * currentIteration / effect_cycles));
+    {
+        noise_time = 0.5 * currentIteration / effect_cycles;
+
+        if (use_compute)
+        {
+            GL_CALL(glUseProgram(computeProg));
+            GL_CALL(glUniform1f(5, 2 * _w));
+            GL_CALL(glUniform1f(6, 2 * _h));
+            GL_CALL(glUniform1f(7, gravity));
+            GL_CALL(glUniform1f(8, noise_time));
 
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, rand_tex));
-        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, rand_tex));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        }
 
         wf_particle_system::simulate();
 
@@ -141,22 +220,112 @@ class fire_particle_system : public wf_particle_system
 
     void add_offset(float dx, float dy)
     {
-        global_dx += dx;
-        global_dy += dy;
+        globalOffset += glm::vec2(dx, dy);
+    }
+
+    /* fire_compute.glsl. The integration is done in a loop without branches,
+     * which can be vectorised, the noise is sampled only for the moving particles */
+    void cpu_update(size_t start, size_t end, float *centers, float *colors)
+    {
+        const int max_life = particleLife;
+        const float maxw = 2 * _w, maxh = 2 * _h;
+        const float g = gravity, time = noise_time;
+        const glm::vec4 scol = startColor;
+
+        float *__restrict__ x = cpu.x.data(), *__restrict__ y = cpu.y.data();
+        float *__restrict__ dy = cpu.dy.data();
+        const float *__restrict__ dx = cpu.dx.data();
+        float *__restrict__ r = cpu.r.data(), *__restrict__ gr = cpu.g.data();
+        float *__restrict__ b = cpu.b.data(), *__restrict__ a = cpu.a.data();
+        int *__restrict__ life = cpu.life.data(), *__restrict__ state = cpu.state.data();
+
+        for (size_t i = start; i < end; i++)
+        {
+            int st = state[i];
+            bool resp = st == PARTICLE_RESP;
+            bool dead = !resp && (life[i] > max_life || st == PARTICLE_DEAD);
+            bool alive = !resp && !dead;
+
+            /* dead particles are moved out of the screen */
+            y[i] = resp ? 0.0f : (dead ? 1000.0f : y[i] + dy[i]);
+            dy[i] = alive ? dy[i] + g : dy[i];
+
+            r[i] = resp ? scol.r : r[i];
+            gr[i] = resp ? scol.g : gr[i];
+            b[i] = resp ? scol.b : b[i];
+            a[i] = resp ? scol.a : a[i];
+
+            life[i] = resp ? 0 : (alive ? life[i] + 1 : life[i]);
+            state[i] = resp ? PARTICLE_ALIVE : (dead ? PARTICLE_DEAD : st);
+        }
+
+        const float offset = 0.007;
+        const float delta = 0.002;
+
+        for (size_t i = start; i < end; i++)
+        {
+            /* respawned in this step, these don't move yet */
+            if (state[i] != PARTICLE_ALIVE || life[i] == 0)
+                continue;
+
+            float px = x[i], py = y[i];
+            py += (glsl_rand(py, px) - 0.5f) * maxh / 100.f;
+            px += dx[i];
+
+            float bx = px / maxw;
+            float by = py / maxh;
+
+            float v1 = perlin_noise3D(bx, by + offset, time);
+            float v2 = perlin_noise3D(bx + offset, by, time);
+            float v3 = perlin_noise3D(bx - offset, by, time);
+
+            float m = std::max(std::max(v1, v2), v3);
 
-        float data[] = {global_dx, global_dy};
+            bool go_right = (v2 == m && px <= maxw);
+            bool go_left  = (v1 == m && px >= 0.0f);
 
-        GL_CALL(glUseProgram(renderProg));
-        GL_CALL(glUniform2fv(3, 1, data));
+            if (go_left && go_right)
+            {
+                int lr = int(glsl_rand(px, py) * 1000.0f);
+                if (lr > 499)
+                {
+                    go_left = false;
+                } else
+                {
+                    go_right = false;
+                }
+            }
+
+            if (go_left)
+            {
+                px += delta * maxw;
+            } else if (go_right)
+            {
+                px -= delta * maxw;
+            } else
+            {
+                py += delta * maxh * 0.5f;
+            }
+
+            float rand_dx = (glsl_rand(py, px) - 0.5f) * 0.01f * maxw;
+            if (px + rand_dx <= maxw * 1.01f && px + rand_dx >= 0.01f)
+                px += rand_dx;
+            else
+                px -= rand_dx;
+
+            x[i] = px;
+            y[i] = py;
+        }
+
+        cpu_write_vertices(start, end, centers, colors);
     }
 };
 
-void wf_fire_effect::init(wayfire_view win, int fr_cnt, bool burnout)
+void wf_fire_effect::init(wayfire_view win, int dur, bool burnout)
 {
 
     this->burnout = burnout;
     this->w = win;
-    effect_cycles = fr_cnt;
 
     auto x = w->geometry.x,
          y = w->geometry.y,
@@ -180,14 +349,18 @@ void wf_fire_effect::init(wayfire_view win, int fr_cnt, bool burnout)
      * however try not to make the effect too short */
     float percent = 1.0 * he / sh;
     percent = std::pow(percent, 1.0 / 5.0);
-    fr_cnt *= percent;
+    dur *= percent;
+
+    duration = wf_duration(win->output, dur, wf_animation::linear);
+    duration.start();
+
+    int fr_cnt = std::max(1, dur / std::max(1, core->ec->repaint_msec));
     effect_cycles = fr_cnt;
 
     ps = new fire_particle_system(avg(tlx, brx), avg(tly, bry),
             wi / sw, he / sh, MAX_PARTICLES, fr_cnt * 3, fr_cnt);
 
     win->transform.color = glm::vec4(1, 1, 1, 0);
-    progress = 0;
 
     last_geometry = win->geometry;
 }
@@ -209,14 +382,20 @@ bool wf_fire_effect::step()
         last_geometry = w->geometry;
     }
 
-    ps->simulate();
-    adjust_alpha();
+    /* catch up with the frame time, on fast outputs
+     * this doesn't simulate on every frame */
+    float a = duration.progress();
+    int due = 1 + a * effect_cycles;
+    while (ps->iteration() < due)
+        ps->simulate();
+    ps->check();
+
+    adjust_alpha(a);
 
     if(w->is_mapped)
     {
         pixman_region32_t visible_region;
 
-        float a = 1.0 * progress / effect_cycles;
         if (burnout)
         {
             pixman_region32_init_rect(&visible_region,
@@ -236,7 +415,7 @@ bool wf_fire_effect::step()
         ps->render();
     }
 
-    return ps->check() <= effect_cycles;
+    return duration.running();
 }
 
 wf_fire_effect::~wf_fire_effect()
@@ -245,14 +424,12 @@ wf_fire_effect::~wf_fire_effect()
     delete ps;
 }
 
-void wf_fire_effect::adjust_alpha()
+void wf_fire_effect::adjust_alpha(float progress)
 {
+    wf_transition alpha = {0.5f, 1.0f};
     if (burnout)
-    {
-        w->transform.color[3] = GetProgress(1.0f, 0.5f, progress, effect_cycles);
-    } else
-    {
-        w->transform.color[3] = GetProgress(0.5f, 1.0f, progress, effect_cycles);
-    }
-    ++progress;
+        std::swap(alpha.start, alpha.end);
+
+    float c = wf_animation::circle(progress);
+    w->transform.color[3] = c * alpha.end + (1 - c) * alpha.start;
 }
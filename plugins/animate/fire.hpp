@@ -14,13 +14,16 @@ class wf_fire_effect : public animation_base
 
     weston_geometry last_geometry;
 
-    int progress = 0, effect_cycles;
+    /* the particles are simulated in steps of the nominal frame length,
+     * effect_cycles of them during the whole duration */
+    wf_duration duration;
+    int effect_cycles;
     bool burnout;
 
-    void adjust_alpha();
+    void adjust_alpha(float progress);
 
     public:
-        void init(wayfire_view win, int fr_cnt, bool burnout);
+        void init(wayfire_view win, int dur, bool burnout);
         bool step();
         ~wf_fire_effect();
 };
@@ -2,12 +2,12 @@
 #include <opengl.hpp>
 #include <config.h>
 #include <debug.hpp>
+#include <core.hpp>
+#include <thread-pool.hpp>
 
-#include <GLES3/gl32.h>
-#include <GLES3/gl3ext.h>
 #include <EGL/egl.h>
-
-#include <thread>
+#include <algorithm>
+#include <vector>
 
 glm::vec4 operator * (glm::vec4 v, float x)
 {
@@ -27,22 +27,54 @@ glm::vec4 operator / (glm::vec4 v, float x)
     return v;
 }
 
+#if USE_GLES32
 template<class T>
 T *get_shader_storage_buffer(GLuint bufID, size_t arrSize)
 {
+    /* the storage is allocated once, when the buffer is created */
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufID);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, arrSize, NULL, GL_STATIC_DRAW);
 
     GLint mask =  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
 
     return (T*) glMapBufferRange(GL_SHADER_STORAGE_BUFFER,
                                  0, arrSize, mask);
 }
+#endif
+
+/* The GL objects of a particle system. When the system is destroyed
+ * they are put in a pool and reused by the next one with the same
+ * number of particles, so they're allocated only once */
+struct wf_particle_buffers
+{
+    size_t size;
+    GLuint vao, base_mesh;
+    GLuint particle_ssbo, life_info_ssbo;
+    GLuint stream_vbo;
+};
+
+/* enough for a few windows opened or closed at once */
+static const size_t max_pooled_buffers = 16;
+static std::vector<wf_particle_buffers> buffer_pool;
 
 /* Implementation of ParticleSystem */
 
+/* The programs are the same for all particle systems, so they are compiled
+ * once and kept. Weston renders all outputs with a single GL context, so
+ * they can be shared between the outputs too. Uniforms which depend on the
+ * particle system are set each time the program is used */
 void wf_particle_system::load_rendering_program()
 {
+    static GLuint program = 0;
+    static GLint radii, offset;
+
+    if (program)
+    {
+        renderProg = program;
+        radiiUniform = radii;
+        offsetUniform = offset;
+        return;
+    }
+
     renderProg = glCreateProgram();
     GLuint vss, fss;
     std::string shaderSrcPath = INSTALL_PREFIX"/share/wayfire/animate/shaders";
@@ -57,13 +89,25 @@ void wf_particle_system::load_rendering_program()
     GL_CALL(glAttachShader (renderProg, fss));
 
     GL_CALL(glLinkProgram (renderProg));
-    GL_CALL(glUseProgram(renderProg));
 
-    GL_CALL(glUniform1f(4, std::sqrt(2.0) * particleSize));
+    radiiUniform = GL_CALL(glGetUniformLocation(renderProg, "radii"));
+    offsetUniform = GL_CALL(glGetUniformLocation(renderProg, "global_offset"));
+
+    program = renderProg;
+    radii = radiiUniform;
+    offset = offsetUniform;
 }
 
 void wf_particle_system::load_compute_program()
 {
+#if USE_GLES32
+    static GLuint program = 0;
+    if (program)
+    {
+        computeProg = program;
+        return;
+    }
+
     std::string shaderSrcPath = INSTALL_PREFIX"/share/wayfire/animate/shaders";
 
     computeProg = GL_CALL(glCreateProgram());
@@ -74,81 +118,120 @@ void wf_particle_system::load_compute_program()
 
     GL_CALL(glAttachShader(computeProg, css));
     GL_CALL(glLinkProgram(computeProg));
-    GL_CALL(glUseProgram(computeProg));
 
-    GL_CALL(glUniform1i(1, particleLife));
+    program = computeProg;
+#endif
 }
 
 void wf_particle_system::load_gles_programs()
 {
     load_rendering_program();
-    load_compute_program();
+    if (use_compute)
+        load_compute_program();
 }
 
 void wf_particle_system::create_buffers()
 {
+    particleBufSz = maxParticles * sizeof(particle_t);
+    lifeBufSz = maxParticles * sizeof(int);
+    /* 2 floats for the center and 4 for the color of each particle */
+    streamBufSz = maxParticles * 6 * sizeof(float);
+
+    auto it = std::find_if(buffer_pool.begin(), buffer_pool.end(),
+        [=] (const wf_particle_buffers& bufs) { return bufs.size == maxParticles; });
+
+    if (it != buffer_pool.end())
+    {
+        vao = it->vao;
+        base_mesh = it->base_mesh;
+        particleSSbo = it->particle_ssbo;
+        lifeInfoSSbo = it->life_info_ssbo;
+        streamVbo = it->stream_vbo;
+
+        buffer_pool.erase(it);
+        return;
+    }
+
+    GL_CALL(glGenVertexArrays(1, &vao));
     GL_CALL(glGenBuffers(1, &base_mesh));
-    GL_CALL(glGenBuffers(1, &particleSSbo));
-    GL_CALL(glGenBuffers(1, &lifeInfoSSbo));
+
+    if (use_compute)
+    {
+#if USE_GLES32
+        GL_CALL(glGenBuffers(1, &particleSSbo));
+        GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSSbo));
+        GL_CALL(glBufferData(GL_SHADER_STORAGE_BUFFER, particleBufSz, NULL, GL_STATIC_DRAW));
+
+        GL_CALL(glGenBuffers(1, &lifeInfoSSbo));
+        GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, lifeInfoSSbo));
+        GL_CALL(glBufferData(GL_SHADER_STORAGE_BUFFER, lifeBufSz, NULL, GL_STATIC_DRAW));
+        GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+#endif
+    } else
+    {
+        GL_CALL(glGenBuffers(1, &streamVbo));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, streamVbo));
+        GL_CALL(glBufferData(GL_ARRAY_BUFFER, streamBufSz, NULL, GL_STREAM_DRAW));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+}
+
+void wf_particle_system::release_buffers()
+{
+    if (buffer_pool.size() < max_pooled_buffers)
+    {
+        buffer_pool.push_back({maxParticles, vao, base_mesh,
+                particleSSbo, lifeInfoSSbo, streamVbo});
+        return;
+    }
+
+    GL_CALL(glDeleteBuffers(1, &particleSSbo));
+    GL_CALL(glDeleteBuffers(1, &lifeInfoSSbo));
+    GL_CALL(glDeleteBuffers(1, &streamVbo));
+    GL_CALL(glDeleteBuffers(1, &base_mesh));
+    GL_CALL(glDeleteVertexArrays(1, &vao));
 }
 
-void wf_particle_system::default_particle_initer(particle_t &p)
+void wf_particle_system::default_particle_initer(particle_t &p, std::minstd_rand& rng)
 {
     p.life = particleLife + 1;
 
     p.x = p.y = -2;
-    p.dx = float(std::rand() % 1001 - 500) / (500 * particleLife);
-    p.dy = float(std::rand() % 1001 - 500) / (500 * particleLife);
+    p.dx = float(int(rng() % 1001) - 500) / (500 * particleLife);
+    p.dy = float(int(rng() % 1001) - 500) / (500 * particleLife);
 
     p.r = p.g = p.b = p.a = 0;
 }
 
+/* each chunk has its own generator, so the workers don't share any state */
 void wf_particle_system::thread_worker_init_particles(particle_t *p,
-                                                      size_t start, size_t end)
+        size_t start, size_t end, uint32_t seed)
 {
+    std::minstd_rand rng(seed + start);
     for(size_t i = start; i < end; ++i)
-        default_particle_initer(p[i]);
+        default_particle_initer(p[i], rng);
 
 }
 
 void wf_particle_system::init_particle_buffer()
 {
-
-    particleBufSz = maxParticles * sizeof(particle_t);
-
+#if USE_GLES32
     particle_t *p = get_shader_storage_buffer<particle_t>(particleSSbo,
                                                           particleBufSz);
 
-    using namespace std::placeholders;
-    auto threadFunction =
-        std::bind(std::mem_fn(&wf_particle_system::thread_worker_init_particles),
-                  this, _1, _2, _3);
-
-    size_t sz = std::thread::hardware_concurrency();
-
-    int interval = maxParticles / sz;
-    if(maxParticles % sz != 0)
-        ++interval;
-
-    std::vector<std::thread> threads;
-    threads.resize(sz);
-
-    for(size_t i = 0; i < sz; ++i)
-    {
-        auto start = i * interval;
-        auto end   = std::min((i + 1) * interval, maxParticles);
-        threads[i] = std::thread(threadFunction, p, start, end);
-    }
-
-    for(size_t i = 0; i < sz; ++i)
-        threads[i].join();
+    const size_t min_chunk = 1024;
+    uint32_t seed = std::rand();
+    core->get_thread_pool().parallel_for(0, maxParticles, min_chunk,
+        [=] (size_t start, size_t end)
+        { thread_worker_init_particles(p, start, end, seed); });
 
     GL_CALL(glUnmapBuffer(GL_SHADER_STORAGE_BUFFER));
+#endif
 }
 
 void wf_particle_system::init_life_info_buffer()
 {
-    lifeBufSz = sizeof(int) * maxParticles;
+#if USE_GLES32
     int *lives = get_shader_storage_buffer<int>(lifeInfoSSbo, lifeBufSz);
 
     for(size_t i = 0; i < maxParticles; ++i)
@@ -156,6 +239,49 @@ void wf_particle_system::init_life_info_buffer()
 
     GL_CALL(glUnmapBuffer(GL_SHADER_STORAGE_BUFFER));
     GL_CALL(memoryBarrierProc(GL_ALL_BARRIER_BITS));
+#endif
+}
+
+void wf_particle_system::particle_arrays::resize(size_t n)
+{
+    for (auto arr : {&x, &y, &dx, &dy, &r, &g, &b, &a})
+        arr->resize(n);
+
+    life.resize(n);
+    state.assign(n, PARTICLE_DEAD);
+}
+
+void wf_particle_system::init_cpu_buffers()
+{
+    cpu.resize(maxParticles);
+
+    const size_t min_chunk = 1024;
+    uint32_t seed = std::rand();
+    core->get_thread_pool().parallel_for(0, maxParticles, min_chunk,
+        [=] (size_t start, size_t end)
+        {
+            std::minstd_rand rng(seed + start);
+            for (size_t i = start; i < end; i++)
+            {
+                particle_t p = {};
+                default_particle_initer(p, rng);
+
+                cpu.x[i] = p.x;   cpu.y[i] = p.y;
+                cpu.dx[i] = p.dx; cpu.dy[i] = p.dy;
+                cpu.r[i] = p.r;   cpu.g[i] = p.g;
+                cpu.b[i] = p.b;   cpu.a[i] = p.a;
+                cpu.life[i] = p.life;
+            }
+        });
+
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, streamVbo));
+    auto centers = (float*) GL_CALL(glMapBufferRange(GL_ARRAY_BUFFER, 0, streamBufSz,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+    cpu_write_vertices(0, maxParticles, centers, centers + 2 * maxParticles);
+
+    GL_CALL(glUnmapBuffer(GL_ARRAY_BUFFER));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 }
 
 void wf_particle_system::gen_base_mesh()
@@ -167,42 +293,46 @@ void wf_particle_system::gen_base_mesh()
 
 void wf_particle_system::upload_base_mesh()
 {
-    GL_CALL(glUseProgram(renderProg));
-
-    GL_CALL(glGenVertexArrays(1, &vao));
-    GL_CALL(glBindVertexArray(vao));
-
-    /* upload static base mesh */
-    GL_CALL(glEnableVertexAttribArray(0));
+    /* the attributes are set up in render() */
     GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, base_mesh));
     GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(vertices),
                          vertices, GL_STATIC_DRAW));
-    GL_CALL(glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, 0));
-    GL_CALL(glDisableVertexAttribArray(0));
-
-    GL_CALL(glBindVertexArray(0));
     GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
-    GL_CALL(glUseProgram(0));
 }
 
 void wf_particle_system::init_gles_part()
 {
+#if USE_GLES32
     memoryBarrierProc =
         (PFNGLMEMORYBARRIERPROC) eglGetProcAddress("glMemoryBarrier");
     dispatchComputeProc =
         (PFNGLDISPATCHCOMPUTEPROC) eglGetProcAddress("glDispatchCompute");
 
-    if (!memoryBarrierProc || !dispatchComputeProc)
-    {
-        errio << "missing compute shader functionality, can't use fire effect!" << std::endl;
-        return;
-    }
+    /* eglGetProcAddress() may return entry points the context doesn't support */
+    GLint major = 0, minor = 0;
+    GL_CALL(glGetIntegerv(GL_MAJOR_VERSION, &major));
+    GL_CALL(glGetIntegerv(GL_MINOR_VERSION, &minor));
+
+    use_compute = (major > 3 || (major == 3 && minor >= 1)) &&
+        memoryBarrierProc && dispatchComputeProc;
+    if (!use_compute)
+        debug << "missing compute shader functionality, simulating particles on the CPU" << std::endl;
+#endif
+
+    particleRadius = std::sqrt(2.0) * particleSize;
 
     load_gles_programs();
     create_buffers();
 
-    init_particle_buffer();
-    init_life_info_buffer();
+    if (use_compute)
+    {
+        init_particle_buffer();
+        init_life_info_buffer();
+    } else
+    {
+        init_cpu_buffers();
+    }
+
     gen_base_mesh();
     upload_base_mesh();
 }
@@ -210,13 +340,9 @@ void wf_particle_system::init_gles_part()
 void wf_particle_system::set_particle_color(glm::vec4 scol,
                                             glm::vec4 ecol)
 {
-
-    GL_CALL(glUseProgram(computeProg));
-    GL_CALL(glUniform4fv(2, 1, &scol[0]));
-    GL_CALL(glUniform4fv(3, 1, &ecol[0]));
-
-    auto tmp = (ecol - scol) / float(particleLife);
-    GL_CALL(glUniform4fv(4, 1, &tmp[0]));
+    startColor = scol;
+    endColor = ecol;
+    colorStep = (ecol - scol) / float(particleLife);
 }
 
 wf_particle_system::wf_particle_system() {}
@@ -237,22 +363,44 @@ wf_particle_system::wf_particle_system(float size,  size_t _maxp,
 
 wf_particle_system::~wf_particle_system()
 {
-
-    GL_CALL(glDeleteBuffers(1, &particleSSbo));
-    GL_CALL(glDeleteBuffers(1, &lifeInfoSSbo));
-    GL_CALL(glDeleteBuffers(1, &base_mesh));
-    GL_CALL(glDeleteVertexArrays(1, &vao));
-
-    GL_CALL(glDeleteProgram(renderProg));
-    GL_CALL(glDeleteProgram(computeProg));
+    release_buffers();
 }
 
 void wf_particle_system::pause () {spawnNew = false;}
 void wf_particle_system::resume() {spawnNew = true; }
 
+void wf_particle_system::spawn_particles(int *lives)
+{
+    size_t sp_num = partSpawn, i = 0;
+
+    while(i < maxParticles && sp_num > 0)
+    {
+        if(lives[i] == PARTICLE_DEAD)
+        {
+            lives[i] = PARTICLE_RESP;
+            --sp_num;
+        }
+
+        ++i;
+    }
+}
+
 void wf_particle_system::simulate()
 {
+    if (use_compute)
+        simulate_gpu();
+    else
+        simulate_cpu();
+}
+
+void wf_particle_system::simulate_gpu()
+{
+#if USE_GLES32
     GL_CALL(glUseProgram(computeProg));
+    GL_CALL(glUniform1i(1, particleLife));
+    GL_CALL(glUniform4fv(2, 1, &startColor[0]));
+    GL_CALL(glUniform4fv(3, 1, &endColor[0]));
+    GL_CALL(glUniform4fv(4, 1, &colorStep[0]));
 
     if(currentIteration++ % respawnInterval == 0 && spawnNew)
     {
@@ -264,18 +412,7 @@ void wf_particle_system::simulate()
                                              sizeof(GLint) * maxParticles,
                                              GL_MAP_WRITE_BIT | GL_MAP_READ_BIT));
 
-        size_t sp_num = partSpawn, i = 0;
-
-        while(i < maxParticles && sp_num > 0)
-        {
-            if(lives[i] == 0)
-            {
-                lives[i] = 1;
-                --sp_num;
-            }
-
-            ++i;
-        }
+        spawn_particles(lives);
 
         GL_CALL(glUnmapBuffer(GL_SHADER_STORAGE_BUFFER));
         GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
@@ -288,6 +425,79 @@ void wf_particle_system::simulate()
     GL_CALL(memoryBarrierProc(GL_ALL_BARRIER_BITS));
     GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
     GL_CALL(glUseProgram(0));
+#endif
+}
+
+void wf_particle_system::simulate_cpu()
+{
+    if(currentIteration++ % respawnInterval == 0 && spawnNew)
+        spawn_particles(cpu.state.data());
+
+    /* the buffer is orphaned, so we don't wait for the previous frame */
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, streamVbo));
+    auto centers = (float*) GL_CALL(glMapBufferRange(GL_ARRAY_BUFFER, 0, streamBufSz,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    auto colors = centers + 2 * maxParticles;
+
+    const size_t min_chunk = 256;
+    core->get_thread_pool().parallel_for(0, maxParticles, min_chunk,
+        [=] (size_t start, size_t end)
+        { cpu_update(start, end, centers, colors); });
+
+    GL_CALL(glUnmapBuffer(GL_ARRAY_BUFFER));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+/* compute.glsl. The loop has no branches, so that it can be vectorised */
+void wf_particle_system::cpu_update(size_t start, size_t end,
+        float *centers, float *colors)
+{
+    const int max_life = particleLife;
+    const glm::vec4 scol = startColor, step = colorStep;
+
+    float *__restrict__ x = cpu.x.data(), *__restrict__ y = cpu.y.data();
+    float *__restrict__ r = cpu.r.data(), *__restrict__ g = cpu.g.data();
+    float *__restrict__ b = cpu.b.data(), *__restrict__ a = cpu.a.data();
+    const float *__restrict__ dx = cpu.dx.data(), *__restrict__ dy = cpu.dy.data();
+    int *__restrict__ life = cpu.life.data(), *__restrict__ state = cpu.state.data();
+
+    for (size_t i = start; i < end; i++)
+    {
+        bool resp = state[i] == PARTICLE_RESP;
+        int l = resp ? 0 : life[i];
+
+        /* particles which exceeded their life aren't changed at all */
+        bool alive = l <= max_life;
+        float step_mul = alive ? 1.0f : 0.0f;
+
+        x[i] = (resp ? 0.0f : x[i]) + step_mul * dx[i];
+        y[i] = (resp ? 0.0f : y[i]) + step_mul * dy[i];
+
+        r[i] = (resp ? scol.r : r[i]) + step_mul * step.r;
+        g[i] = (resp ? scol.g : g[i]) + step_mul * step.g;
+        b[i] = (resp ? scol.b : b[i]) + step_mul * step.b;
+        a[i] = (resp ? scol.a : a[i]) + step_mul * step.a;
+
+        life[i] = alive ? l + 1 : life[i];
+        state[i] = alive ? (resp ? PARTICLE_ALIVE : state[i]) : PARTICLE_DEAD;
+    }
+
+    cpu_write_vertices(start, end, centers, colors);
+}
+
+void wf_particle_system::cpu_write_vertices(size_t start, size_t end,
+        float *centers, float *colors)
+{
+    for (size_t i = start; i < end; i++)
+    {
+        centers[2 * i + 0] = cpu.x[i];
+        centers[2 * i + 1] = cpu.y[i];
+
+        colors[4 * i + 0] = cpu.r[i];
+        colors[4 * i + 1] = cpu.g[i];
+        colors[4 * i + 2] = cpu.b[i];
+        colors[4 * i + 3] = cpu.a[i];
+    }
 }
 
 
@@ -295,6 +505,9 @@ void wf_particle_system::simulate()
 void wf_particle_system::render()
 {
     GL_CALL(glUseProgram(renderProg));
+    GL_CALL(glUniform1f(radiiUniform, particleRadius));
+    GL_CALL(glUniform2fv(offsetUniform, 1, &globalOffset[0]));
+
     GL_CALL(glEnable(GL_BLEND));
     GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE));
 
@@ -306,16 +519,23 @@ void wf_particle_system::render()
     GL_CALL(glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, 0));
 
     GL_CALL(glEnableVertexAttribArray(1));
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, particleSSbo));
-    GL_CALL(glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE,
-                                   sizeof(particle_t), 0));
-
     GL_CALL(glEnableVertexAttribArray(2));
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, particleSSbo));
 
-    GL_CALL(glVertexAttribPointer (2, 4, GL_FLOAT, GL_FALSE,
-                                   sizeof(particle_t),
-                                   (void*) (4 * sizeof(float))));
+    if (use_compute)
+    {
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, particleSSbo));
+        GL_CALL(glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE,
+                                       sizeof(particle_t), 0));
+        GL_CALL(glVertexAttribPointer (2, 4, GL_FLOAT, GL_FALSE,
+                                       sizeof(particle_t),
+                                       (void*) (4 * sizeof(float))));
+    } else
+    {
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, streamVbo));
+        GL_CALL(glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 0, 0));
+        GL_CALL(glVertexAttribPointer (2, 4, GL_FLOAT, GL_FALSE, 0,
+                                       (void*) (2 * maxParticles * sizeof(float))));
+    }
 
     GL_CALL(glVertexAttribDivisor(0, 0));
     GL_CALL(glVertexAttribDivisor(1, 1));
@@ -1,14 +1,27 @@
 #ifndef PARTICLE_H_
 #define PARTICLE_H_
 #include <core.hpp>
+#include <config.h>
 #include <glm/glm.hpp>
+#include <vector>
+#include <random>
+
+#if USE_GLES32
 #include <GLES3/gl32.h>
+#else
+#include <GLES3/gl3.h>
+#endif
 #include <GLES3/gl3ext.h>
 
 #define NUM_PARTICLES maxParticles
 #define WORKGROUP_SIZE 512
 #define WORKGROUP_COUNT ((maxParticles + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE)
 
+/* values of the life info, the same as in the compute shaders */
+#define PARTICLE_DEAD  0
+#define PARTICLE_RESP  1
+#define PARTICLE_ALIVE 2
+
 glm::vec4 operator * (glm::vec4 v, float num);
 glm::vec4 operator / (glm::vec4 v, float num);
 
@@ -43,14 +56,39 @@ class wf_particle_system
     size_t respawnInterval;
 
     float particleSize;
+    /* radius of the particles in the fragment shader */
+    float particleRadius;
+    glm::vec2 globalOffset = {0, 0};
 
     GLint renderProg,
-          computeProg;
+          computeProg = 0;
+    GLint radiiUniform, offsetUniform;
     GLuint vao;
     GLuint base_mesh;
 
     size_t particleBufSz, lifeBufSz;
-    GLuint particleSSbo, lifeInfoSSbo;
+    GLuint particleSSbo = 0, lifeInfoSSbo = 0;
+
+    /* Without compute shaders(GLES 3.0/3.1 or a missing driver feature)
+     * the particles are simulated on the CPU. They are stored as a structure
+     * of arrays, so that the update loops can be vectorised, and the update
+     * is split between the threads of the core thread pool. After each step
+     * the centers and colors are streamed to streamVbo, first all centers
+     * then all colors */
+    bool use_compute = false;
+
+    struct particle_arrays
+    {
+        std::vector<float> x, y, dx, dy, r, g, b, a;
+        std::vector<int> life, state;
+
+        void resize(size_t n);
+    } cpu;
+
+    GLuint streamVbo = 0;
+    size_t streamBufSz;
+
+    glm::vec4 startColor, endColor, colorStep;
 
     float vertices[12] = {
         -1.f, -1.f,
@@ -62,8 +100,10 @@ class wf_particle_system
 
     bool spawnNew = true;
 
+#if USE_GLES32
     PFNGLMEMORYBARRIERPROC memoryBarrierProc = 0;
     PFNGLDISPATCHCOMPUTEPROC dispatchComputeProc = 0;
+#endif
 
     /* creates program, VAO, VBO ... */
     virtual void init_gles_part();
@@ -72,15 +112,33 @@ class wf_particle_system
     virtual void load_compute_program();
     virtual void load_gles_programs();
 
+    /* takes the buffers from the pool or creates new ones */
     virtual void create_buffers();
+    virtual void release_buffers();
 
-    /* to change initial particle spawning,
-     * override defaultparticle_tIniter */
-    virtual void default_particle_initer(particle_t &p);
+    /* to change initial particle spawning, override default_particle_initer.
+     * It runs on the worker threads, so it must use only rng for randomness */
+    virtual void default_particle_initer(particle_t &p, std::minstd_rand& rng);
     virtual void thread_worker_init_particles(particle_t *buff,
-            size_t start, size_t end);
+            size_t start, size_t end, uint32_t seed);
     virtual void init_particle_buffer();
     virtual void init_life_info_buffer();
+    virtual void init_cpu_buffers();
+
+    /* marks up to partSpawn dead particles for respawning */
+    void spawn_particles(int *lives);
+
+    virtual void simulate_gpu();
+    virtual void simulate_cpu();
+
+    /* The CPU version of the compute shader, updates the particles in
+     * [start, end) and writes their centers and colors. It runs on the worker
+     * threads, so it mustn't use GL */
+    virtual void cpu_update(size_t start, size_t end,
+            float *centers, float *colors);
+    /* copies the updated particles to the stream buffer */
+    void cpu_write_vertices(size_t start, size_t end,
+            float *centers, float *colors);
 
     virtual void gen_base_mesh();
     virtual void upload_base_mesh();
@@ -1,10 +1,10 @@
-#version 310 es
+#version 300 es
 
 in mediump vec4 out_color;
 in mediump vec2 pos;
 out mediump vec4 fragColor;
 
-layout(location = 4) uniform highp float radii;
+uniform highp float radii;
 
 void main()
 {
@@ -13,22 +13,19 @@ class wf_system_fade
     weston_surface *surface = nullptr;
     weston_view *view = nullptr;
 
-    int frame_count, current_step = 0;
     wayfire_output *output;
+    wf_duration duration;
     effect_hook_t hook;
 
     public:
-        wf_system_fade(wayfire_output *out, int fr_count) :
-            frame_count(fr_count), output(out)
+        wf_system_fade(wayfire_output *out, int dur) :
+            output(out), duration(out, dur)
         {
             surface = weston_surface_create(core->ec);
             view = weston_view_create(surface);
 
             if (!surface || !view)
-            {
-                current_step = frame_count;
                 return;
-            }
 
             weston_surface_set_color(surface, 0, 0, 0, 1.0);
 
@@ -39,6 +36,7 @@ class wf_system_fade
 
             weston_layer_entry_insert(&core->ec->fade_layer.view_list, &view->layer_link);
 
+            duration.start();
             hook = [=] () { step(); };
             output->render->add_output_effect(&hook);
             output->render->auto_redraw(true);
@@ -46,12 +44,12 @@ class wf_system_fade
 
         void step()
         {
-            float color = GetProgress(1, 0, current_step, frame_count);
+            float color = duration.progress(1, 0);
             weston_surface_set_color(surface, 0, 0, 0, color);
             weston_view_geometry_dirty(view);
             weston_view_schedule_repaint(view);
 
-            if (current_step++ >= frame_count)
+            if (!duration.running())
             {
                 auto loop = wl_display_get_event_loop(core->ec->wl_display);
                 wl_event_loop_add_idle(loop, destroy_system_fade, this);
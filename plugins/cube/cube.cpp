@@ -3,6 +3,7 @@
 #include <core.hpp>
 #include <render-manager.hpp>
 #include <workspace-manager.hpp>
+#include <animation.hpp>
 
 #include <compositor.h>
 #include <linux/input-event-codes.h>
@@ -45,17 +46,15 @@ class wayfire_cube : public wayfire_plugin_t {
 #endif
     } program;
 
-    struct duple { float start, end; };
-
     struct
     {
-        duple offset_y;
-        duple offset_z;
-        duple rotation;
-        int current_step, max_steps;
+        wf_transition offset_y;
+        wf_transition offset_z;
+        wf_transition rotation;
+        wf_duration duration;
 
 #if USE_GLES32
-        duple ease_deformation;
+        wf_transition ease_deformation;
 #endif
 
         bool in_exit, active = false;
@@ -84,7 +83,8 @@ class wayfire_cube : public wayfire_plugin_t {
         YVelocity  = section->get_double("speed_spin_vert",  0.01);
         ZVelocity  = section->get_double("speed_zoom",       0.05);
 
-        animation.max_steps  = section->get_duration("initial_animation", 30);
+        animation.duration = wf_duration(output,
+                section->get_duration("initial_animation", 480));
 
         backgroud_color = section->get_color("background", {0, 0, 0, 1});
 
@@ -107,8 +107,8 @@ class wayfire_cube : public wayfire_plugin_t {
                 input_released();
         };
 
-        grab_interface->callbacks.pointer.motion = [=] (weston_pointer* ptr,
-                weston_pointer_motion_event*)
+        grab_interface->callbacks.pointer.frame_motion = [=] (weston_pointer* ptr,
+                wl_fixed_t, wl_fixed_t)
         {
             pointer_moved(wl_fixed_to_int(ptr->x), wl_fixed_to_int(ptr->y));
         };
@@ -223,7 +223,7 @@ class wayfire_cube : public wayfire_plugin_t {
         offset = 0;
         offsetVert = 0;
         zoomFactor = 1;
-        animation.current_step = 0;
+        animation.duration.start();
         animation.in_exit = false;
         animation.offset_z = {coeff + COEFF_DELTA_NEAR, coeff + COEFF_DELTA_FAR};
 
@@ -240,46 +240,24 @@ class wayfire_cube : public wayfire_plugin_t {
 
     bool update_animation()
     {
-        float z_offset = GetProgress(animation.offset_z.start,
-                                     animation.offset_z.end,
-                                     animation.current_step,
-                                     animation.max_steps);
+        float z_offset = animation.duration.progress(animation.offset_z);
 
 #if USE_GLES32
-        current_ease = GetProgress(animation.ease_deformation.start,
-                                   animation.ease_deformation.end,
-                                   animation.current_step,
-                                   animation.max_steps);
+        current_ease = animation.duration.progress(animation.ease_deformation);
 #endif
 
         /* also update rotation and Y offset */
         if (animation.in_exit)
         {
-            offsetVert = GetProgress(animation.offset_y.start,
-                                   animation.offset_y.end,
-                                   animation.current_step,
-                                   animation.max_steps);
-
-            offset = GetProgress(animation.rotation.start,
-                                 animation.rotation.end,
-                                 animation.current_step,
-                                 animation.max_steps);
+            offsetVert = animation.duration.progress(animation.offset_y);
+            offset = animation.duration.progress(animation.rotation);
         }
 
         view = glm::lookAt(glm::vec3(0., offsetVert, z_offset),
                 glm::vec3(0., 0., 0.),
                 glm::vec3(0., 1., 0.));
 
-        if (animation.current_step < animation.max_steps)
-        {
-            ++animation.current_step;
-            if (animation.current_step == animation.max_steps)
-                return false;
-            else
-                return true;
-        }
-
-        return false;
+        return animation.duration.running();
     }
 
     void render()
@@ -392,7 +370,7 @@ class wayfire_cube : public wayfire_plugin_t {
         output->workspace->set_workspace(std::make_tuple(nvx, vy));
 
         animation.in_exit = true;
-        animation.current_step = 0;
+        animation.duration.start();
         animation.offset_z = {coeff + COEFF_DELTA_FAR, coeff + COEFF_DELTA_NEAR};
         animation.offset_y = {offsetVert, 0};
         animation.rotation = {offset + 1.0f * dvx * angle, 0};
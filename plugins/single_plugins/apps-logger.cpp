@@ -1,60 +1,503 @@
 #include <output.hpp>
 #include <core.hpp>
+#include <debug.hpp>
 #include <workspace-manager.hpp>
 #include <signal-definitions.hpp>
 #include <view.hpp>
-#include <set>
-#include <fstream>
+#include <config.hpp>
 
-using function = std::function<void()>;
-void idle_callback(void *data)
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+The list of open views is streamed to the clients of a Unix socket, by default
+$XDG_RUNTIME_DIR/wayfire-$WAYLAND_DISPLAY.socket. The path is exported to the
+programs started by wayfire as WAYFIRE_SOCKET.
+
+All messages are framed as:
+
+u32 length(of the rest of the message) | u8 type | body
+
+Integers are little endian, strings are u16 length followed by the bytes.
+Views are identified by a u32 id, which is never reused, 0 is "no view".
+
+server -> client, sent as they happen:
+
+1 view created      u32 id, str app_id, str title
+2 view destroyed    u32 id
+3 title changed     u32 id, str app_id, str title
+4 focus changed     u32 id
+5 snapshot          u32 focused id, u32 count, count x (u32 id, str app_id, str title)
+
+client -> server:
+
+1 snapshot request  empty body, the snapshot is sent after the events queued so far
+
+Clients which don't read their messages are disconnected when their queue grows
+over [apps-logger] queue_limit bytes, they can reconnect and request a snapshot.
+ */
+
+enum wf_ipc_message_type
+{
+    IPC_VIEW_CREATED   = 1,
+    IPC_VIEW_DESTROYED = 2,
+    IPC_TITLE_CHANGED  = 3,
+    IPC_FOCUS_CHANGED  = 4,
+    IPC_SNAPSHOT       = 5
+};
+
+enum wf_ipc_request_type
+{
+    IPC_REQUEST_SNAPSHOT = 1
+};
+
+/* requests are tiny, anything bigger is a broken client */
+static const size_t max_request_size = 1024;
+
+struct wf_ipc_message
+{
+    std::string data;
+
+    wf_ipc_message(uint8_t type)
+    {
+        data.resize(4);
+        data.push_back(type);
+    }
+
+    void add_u32(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            data.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    void add_string(const char *str)
+    {
+        size_t len = std::min(std::strlen(str), (size_t)0xffff);
+        data.push_back(len & 0xff);
+        data.push_back(len >> 8);
+        data.append(str, len);
+    }
+
+    /* fills in the length */
+    const std::string& finish()
+    {
+        uint32_t len = data.size() - 4;
+        for (int i = 0; i < 4; i++)
+            data[i] = (len >> (8 * i)) & 0xff;
+
+        return data;
+    }
+};
+
+struct wf_ipc_view_data : public wf_custom_view_data
+{
+    uint32_t id;
+};
+
+#define ipc_view_data "__ipc_view_id"
+
+static uint32_t get_view_id(wayfire_view view)
 {
-    (*(function*)(data))();
+    static uint32_t last_id = 0;
+    if (!view)
+        return 0;
+
+    auto& data = view->custom_data[ipc_view_data];
+    if (!data)
+    {
+        auto id_data = new wf_ipc_view_data;
+        id_data->id = ++last_id;
+        data = id_data;
+    }
+
+    return static_cast<wf_ipc_view_data*> (data)->id;
 }
 
-class wayfire_apps_logger : public wayfire_plugin_t
+static void add_view_info(wf_ipc_message& msg, wayfire_view view)
+{
+    auto app_id = weston_desktop_surface_get_app_id(view->desktop_surface);
+    auto title = weston_desktop_surface_get_title(view->desktop_surface);
+
+    msg.add_u32(get_view_id(view));
+    msg.add_string(app_id ? app_id : "(null)");
+    msg.add_string(title ? title : "(null)");
+}
+
+class wf_ipc_server;
+struct wf_ipc_client
+{
+    wf_ipc_server *server;
+    int fd;
+    wl_event_source *source;
+
+    /* the first message may be partially sent already */
+    std::deque<std::string> queue;
+    size_t queued_bytes = 0, sent_of_first = 0;
+
+    std::string input;
+};
+
+/* A single server is shared by the instances of the plugin on all outputs */
+class wf_ipc_server
 {
-    signal_callback_t created_cb, destroyed_cb;
+    int listen_fd = -1;
+    std::string path;
+    size_t queue_limit;
+
+    wl_event_source *listen_source = NULL;
+    std::list<wf_ipc_client*> clients;
+
+    static int handle_listen_fd(int fd, uint32_t mask, void *data)
+    {
+        ((wf_ipc_server*) data)->accept_client();
+        return 0;
+    }
+
+    static int handle_client_fd(int fd, uint32_t mask, void *data)
+    {
+        auto client = (wf_ipc_client*) data;
+        auto server = client->server;
+
+        if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+        {
+            server->disconnect(client);
+            return 0;
+        }
+
+        if ((mask & WL_EVENT_WRITABLE) && !server->flush(client))
+            return 0;
+
+        if (mask & WL_EVENT_READABLE)
+            server->read_requests(client);
+
+        return 0;
+    }
+
+    /* the socket must exist before autostart runs its commands,
+     * which happens when the plugins are initialized */
+    void start()
+    {
+        if (path.empty())
+        {
+            auto runtime_dir = getenv("XDG_RUNTIME_DIR");
+            auto display = core->wayland_display;
+            if (display.empty() && getenv("WAYLAND_DISPLAY"))
+                display = getenv("WAYLAND_DISPLAY");
+
+            path = std::string(runtime_dir ? runtime_dir : "/tmp") +
+                "/wayfire-" + display + ".socket";
+        }
+
+        sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            errio << "apps-logger: socket path " << path << " is too long" << std::endl;
+            return;
+        }
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            errio << "apps-logger: failed to create socket: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+
+        /* a stale socket from a previous session */
+        unlink(path.c_str());
+        if (bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0)
+        {
+            errio << "apps-logger: failed to listen on " << path << ": "
+                << strerror(errno) << std::endl;
+            close(listen_fd);
+            listen_fd = -1;
+            return;
+        }
+
+        auto loop = wl_display_get_event_loop(core->ec->wl_display);
+        listen_source = wl_event_loop_add_fd(loop, listen_fd, WL_EVENT_READABLE,
+                handle_listen_fd, this);
+
+        /* read by core->run() when it builds the environment of the command */
+        setenv("WAYFIRE_SOCKET", path.c_str(), 1);
+        debug << "apps-logger: listening on " << path << std::endl;
+    }
+
+    void accept_client()
+    {
+        int fd;
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            auto client = new wf_ipc_client;
+            client->server = this;
+            client->fd = fd;
+
+            auto loop = wl_display_get_event_loop(core->ec->wl_display);
+            client->source = wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+                    handle_client_fd, client);
+
+            clients.push_back(client);
+        }
+    }
+
+    void disconnect(wf_ipc_client *client)
+    {
+        wl_event_source_remove(client->source);
+        close(client->fd);
+
+        clients.remove(client);
+        delete client;
+    }
+
+    void update_mask(wf_ipc_client *client)
+    {
+        uint32_t mask = WL_EVENT_READABLE;
+        if (!client->queue.empty())
+            mask |= WL_EVENT_WRITABLE;
+
+        wl_event_source_fd_update(client->source, mask);
+    }
+
+    /* sends as much of the queue as the socket takes,
+     * returns false if the client was disconnected */
+    bool flush(wf_ipc_client *client)
+    {
+        bool was_empty = client->queue.empty();
+        while (!client->queue.empty())
+        {
+            auto& msg = client->queue.front();
+            ssize_t r = send(client->fd, msg.data() + client->sent_of_first,
+                    msg.size() - client->sent_of_first, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+            if (r < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                    break;
+
+                disconnect(client);
+                return false;
+            }
+
+            client->sent_of_first += r;
+            if (client->sent_of_first < msg.size())
+                break;
+
+            client->queued_bytes -= msg.size();
+            client->sent_of_first = 0;
+            client->queue.pop_front();
+        }
+
+        if (was_empty != client->queue.empty())
+            update_mask(client);
 
-    using app = std::pair<std::string, std::string>;
+        return true;
+    }
+
+    void send_message(wf_ipc_client *client, const std::string& msg)
+    {
+        if (client->queued_bytes + msg.size() > queue_limit)
+        {
+            debug << "apps-logger: client queue is full, disconnecting it" << std::endl;
+            disconnect(client);
+            return;
+        }
+
+        client->queue.push_back(msg);
+        client->queued_bytes += msg.size();
 
-    void update_log_file()
+        /* try to send right away, the queue is used only if the socket is full */
+        flush(client);
+    }
+
+    void read_requests(wf_ipc_client *client)
     {
-        std::ofstream out("/tmp/wayfire-app-list",
-                          std::ofstream::trunc | std::ofstream::out);
+        char buf[256];
+        while (true)
+        {
+            ssize_t r = recv(client->fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                disconnect(client);
+                return;
+            }
+
+            if (r < 0)
+                break;
+
+            client->input.append(buf, r);
+        }
 
-        size_t id = 1;
-        output->workspace->for_each_view([&out, &id] (wayfire_view view)
+        auto& in = client->input;
+        while (in.size() >= 4)
         {
-            auto c_app_id = weston_desktop_surface_get_app_id(view->desktop_surface);
-            std::string app_id = c_app_id ? c_app_id : "(null)";
+            uint32_t len = 0;
+            for (int i = 0; i < 4; i++)
+                len |= uint32_t((unsigned char) in[i]) << (8 * i);
 
-            auto c_title = weston_desktop_surface_get_title (view->desktop_surface);
-            std::string title = c_title ? c_title : "(null)";
+            if (len < 1 || len > max_request_size)
+            {
+                disconnect(client);
+                return;
+            }
 
-            out << "no. " << id << " app_id: " << app_id << " title: " << title << std::endl;
-            ++id;
+            if (in.size() < 4 + len)
+                break;
+
+            uint8_t type = in[4];
+            in.erase(0, 4 + len);
+
+            if (type == IPC_REQUEST_SNAPSHOT)
+                send_snapshot(client);
+
+            /* the client may have been disconnected */
+            if (std::find(clients.begin(), clients.end(), client) == clients.end())
+                return;
+        }
+    }
+
+    void send_snapshot(wf_ipc_client *client)
+    {
+        std::vector<wayfire_view> views;
+        core->for_each_output([&views] (wayfire_output *output)
+        {
+            output->workspace->for_each_view([&views] (wayfire_view view)
+            { views.push_back(view); });
         });
+
+        auto active = core->get_active_output();
+
+        wf_ipc_message msg(IPC_SNAPSHOT);
+        msg.add_u32(active ? get_view_id(active->active_view) : 0);
+        msg.add_u32(views.size());
+        for (auto& view : views)
+            add_view_info(msg, view);
+
+        send_message(client, msg.finish());
     }
 
-    function idle_func = [=] () { update_log_file(); };
+    public:
+    int refcount = 0;
+
+    wf_ipc_server(std::string path, size_t queue_limit)
+        : path(path), queue_limit(queue_limit)
+    {
+        start();
+    }
+
+    ~wf_ipc_server()
+    {
+        while (!clients.empty())
+            disconnect(clients.front());
+
+        if (listen_source)
+            wl_event_source_remove(listen_source);
+
+        if (listen_fd >= 0)
+        {
+            close(listen_fd);
+            unlink(path.c_str());
+            unsetenv("WAYFIRE_SOCKET");
+        }
+    }
+
+    void broadcast(wf_ipc_message& msg)
+    {
+        if (clients.empty())
+            return;
+
+        auto& data = msg.finish();
+
+        /* clients can be disconnected while sending */
+        for (auto it = clients.begin(); it != clients.end(); )
+        {
+            auto client = *it++;
+            send_message(client, data);
+        }
+    }
+};
+
+static wf_ipc_server *server = nullptr;
+
+class wayfire_apps_logger : public wayfire_plugin_t
+{
+    signal_callback_t created_cb, destroyed_cb, title_changed_cb, focus_cb;
+
+    void send_view_info(wf_ipc_message_type type, wayfire_view view)
+    {
+        wf_ipc_message msg(type);
+        add_view_info(msg, view);
+        server->broadcast(msg);
+    }
 
     public:
     void init(wayfire_config *config)
     {
+        if (!server)
+        {
+            auto section = config->get_section("apps-logger");
+            server = new wf_ipc_server(section->get_string("socket", ""),
+                    section->get_int("queue_limit", 1 << 20));
+        }
+        ++server->refcount;
+
         created_cb = [=] (signal_data *data)
         {
-            wl_event_loop_add_idle(wl_display_get_event_loop(core->ec->wl_display),
-                                   idle_callback, &idle_func);
+            auto view = static_cast<create_view_signal*> (data)->created_view;
+            send_view_info(IPC_VIEW_CREATED, view);
         };
         output->connect_signal("create-view", &created_cb);
 
         destroyed_cb = [=] (signal_data *data)
         {
-            wl_event_loop_add_idle(wl_display_get_event_loop(core->ec->wl_display),
-                                   idle_callback, &idle_func);
+            auto view = static_cast<destroy_view_signal*> (data)->destroyed_view;
+
+            wf_ipc_message msg(IPC_VIEW_DESTROYED);
+            msg.add_u32(get_view_id(view));
+            server->broadcast(msg);
         };
         output->connect_signal("destroy-view", &destroyed_cb);
+
+        title_changed_cb = [=] (signal_data *data)
+        {
+            auto view = static_cast<view_title_changed_signal*> (data)->view;
+            send_view_info(IPC_TITLE_CHANGED, view);
+        };
+        output->connect_signal("view-title-changed", &title_changed_cb);
+
+        focus_cb = [=] (signal_data *data)
+        {
+            auto view = static_cast<focus_view_signal*> (data)->focus;
+
+            wf_ipc_message msg(IPC_FOCUS_CHANGED);
+            msg.add_u32(get_view_id(view));
+            server->broadcast(msg);
+        };
+        output->connect_signal("focus-view", &focus_cb);
+    }
+
+    void fini()
+    {
+        output->disconnect_signal("create-view", &created_cb);
+        output->disconnect_signal("destroy-view", &destroyed_cb);
+        output->disconnect_signal("view-title-changed", &title_changed_cb);
+        output->disconnect_signal("focus-view", &focus_cb);
+
+        if (--server->refcount == 0)
+        {
+            delete server;
+            server = nullptr;
+        }
     }
 };
 
@@ -3,6 +3,7 @@
 #include <core.hpp>
 #include <linux/input.h>
 #include <linux/input-event-codes.h>
+#include <sstream>
 
 #define NUMBER_COMMANDS 10
 
@@ -42,11 +43,18 @@ class wayfire_command : public wayfire_plugin_t
             auto comvalue = section->get_string(command, "");
             auto key = section->get_key(binding, {0, 0});
 
+            /* env_<num> = NAME=value NAME2=value2 */
+            std::vector<std::string> env;
+            std::istringstream env_stream(section->get_string("env_" + num, ""));
+            std::string var;
+            while (env_stream >> var)
+                env.push_back(var);
+
             if (key.keyval == 0 || command == "")
                 continue;
 
             v[i++] = [=] (weston_keyboard* kbd, uint32_t key) {
-                core->run(comvalue.c_str());
+                core->run(comvalue.c_str(), env);
             };
 
             output->add_key((weston_keyboard_modifier)key.mod, key.keyval, &v[i - 1]);
@@ -3,6 +3,7 @@
 #include <core.hpp>
 #include <render-manager.hpp>
 #include <workspace-manager.hpp>
+#include <animation.hpp>
 
 #include "../../shared/config.hpp"
 /* TODO: this file should be included in some header maybe(plugin.hpp) */
@@ -19,7 +20,7 @@ class wayfire_expo : public wayfire_plugin_t {
 
         wayfire_color background_color;
 
-        int max_steps;
+        wf_duration zoom_animation;
 
         render_hook_t renderer;
 
@@ -62,7 +63,7 @@ class wayfire_expo : public wayfire_plugin_t {
             }
         }
 
-        max_steps = section->get_duration("duration", 20);
+        zoom_animation = wf_duration(output, section->get_duration("duration", 320));
         delimiter_offset = section->get_int("offset", 10);
 
         toggle_cb = [=] (weston_keyboard *kbd, uint32_t key) {
@@ -101,8 +102,8 @@ class wayfire_expo : public wayfire_plugin_t {
             handle_input_press(ptr->x, ptr->y, state);
 
         };
-        grab_interface->callbacks.pointer.motion = [=] (weston_pointer *ptr,
-                weston_pointer_motion_event *ev)
+        grab_interface->callbacks.pointer.frame_motion = [=] (weston_pointer *ptr,
+                wl_fixed_t, wl_fixed_t)
         {
             handle_input_move(ptr->x, ptr->y);
         };
@@ -410,14 +411,9 @@ class wayfire_expo : public wayfire_plugin_t {
             update_zoom();
     }
 
-    struct tup {
-        float begin, end;
-    };
-
     struct {
-        int steps = 0;
-        tup scale_x, scale_y,
-            off_x, off_y;
+        wf_transition scale_x, scale_y,
+                      off_x, off_y;
     } zoom_target;
 
     void calculate_zoom(bool zoom_in)
@@ -434,7 +430,7 @@ class wayfire_expo : public wayfire_plugin_t {
         float center_w = vw / 2.f;
         float center_h = vh / 2.f;
 
-        zoom_target.steps = 0;
+        zoom_animation.start();
         if (zoom_in) {
             render_params.scale_x = render_params.scale_y = 1;
         } else {
@@ -454,31 +450,20 @@ class wayfire_expo : public wayfire_plugin_t {
 
     void update_zoom()
     {
+        /* zooming in runs the transitions backwards */
+        float progress = zoom_animation.progress();
         if (state.zoom_in)
-        {
-            render_params.scale_x = GetProgress(zoom_target.scale_x.end,
-                    zoom_target.scale_x.begin, zoom_target.steps, max_steps);
-            render_params.scale_y = GetProgress(zoom_target.scale_y.end,
-                    zoom_target.scale_y.begin, zoom_target.steps, max_steps);
-            render_params.off_x = GetProgress(zoom_target.off_x.end,
-                    zoom_target.off_x.begin, zoom_target.steps, max_steps);
-            render_params.off_y = GetProgress(zoom_target.off_y.end,
-                    zoom_target.off_y.begin, zoom_target.steps, max_steps);
-        } else
-        {
-            render_params.scale_x = GetProgress(zoom_target.scale_x.begin,
-                    zoom_target.scale_x.end, zoom_target.steps, max_steps);
-            render_params.scale_y = GetProgress(zoom_target.scale_y.begin,
-                    zoom_target.scale_y.end, zoom_target.steps, max_steps);
-            render_params.off_x = GetProgress(zoom_target.off_x.begin,
-                    zoom_target.off_x.end, zoom_target.steps, max_steps);
-            render_params.off_y = GetProgress(zoom_target.off_y.begin,
-                    zoom_target.off_y.end, zoom_target.steps, max_steps);
-        }
+            progress = 1 - progress;
+
+        auto interpolate = [=] (const wf_transition& t)
+        { return progress * t.end + (1 - progress) * t.start; };
 
-        zoom_target.steps++;
+        render_params.scale_x = interpolate(zoom_target.scale_x);
+        render_params.scale_y = interpolate(zoom_target.scale_y);
+        render_params.off_x   = interpolate(zoom_target.off_x);
+        render_params.off_y   = interpolate(zoom_target.off_y);
 
-        if (zoom_target.steps == max_steps + 1)
+        if (!zoom_animation.running())
         {
             state.in_zoom = false;
             if (state.zoom_in)
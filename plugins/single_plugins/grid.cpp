@@ -3,6 +3,8 @@
 #include <view.hpp>
 #include <workspace-manager.hpp>
 #include <render-manager.hpp>
+#include <animation.hpp>
+#include <opengl.hpp>
 #include <algorithm>
 #include <linux/input-event-codes.h>
 #include "signal-definitions.hpp"
@@ -52,13 +54,20 @@ class wayfire_grid : public wayfire_plugin_t {
 
     signal_callback_t snap_cb, maximized_cb, fullscreen_cb;
 
+    /* The view is configured only once, with its final size. Until the client
+     * commits a buffer with that size, a snapshot of the old contents is moved
+     * and scaled towards the target, then the snapshot is cross-faded to the
+     * new contents of the view */
     struct {
         weston_geometry original, target;
         wayfire_view view;
         bool maximizing = false, fullscreening = false;
+
+        GLuint snapshot_fb = -1, snapshot_tex = -1;
+        bool fading = false;
     } current_view;
 
-    int total_steps, current_step;
+    wf_duration duration, fade;
 
     public:
     void init(wayfire_config *config)
@@ -67,7 +76,9 @@ class wayfire_grid : public wayfire_plugin_t {
         grab_interface->abilities_mask = WF_ABILITY_CHANGE_VIEW_GEOMETRY;
 
         auto section = config->get_section("grid");
-        total_steps = section->get_duration("duration", 15);
+        int length = section->get_duration("duration", 240);
+        duration = wf_duration(output, length);
+        fade = wf_duration(output, length / 2, wf_animation::linear);
 
         for (int i = 1; i < 10; i++) {
             keys[i] = section->get_key("slot_" + slots[i], default_keys[i]);
@@ -81,7 +92,7 @@ class wayfire_grid : public wayfire_plugin_t {
             output->add_key(keys[i].mod, keys[i].keyval, &bindings[i]);
         }
 
-        hook = std::bind(std::mem_fn(&wayfire_grid::update_pos_size), this);
+        hook = std::bind(std::mem_fn(&wayfire_grid::render), this);
 
         using namespace std::placeholders;
         snap_cb = std::bind(std::mem_fn(&wayfire_grid::snap_signal_cb), this, _1);
@@ -139,50 +150,145 @@ class wayfire_grid : public wayfire_plugin_t {
         }
         output->focus_view(nullptr);
 
-        current_step = 0;
+        duration.start();
         current_view.view = view;
         current_view.original = view->geometry;
         current_view.target = {tx, ty, tw, th};
         current_view.maximizing = current_view.fullscreening = false;
+        current_view.fading = false;
 
-        view->set_moving(true);
-        view->set_resizing(true);
-        view->set_geometry(view->geometry);
+        take_snapshot(view);
+        view->set_geometry(current_view.target);
 
+        /* the view itself is drawn by us, on top of the other views */
+        view->transform.color[3] = 0;
+        output->render->set_renderer();
         output->render->auto_redraw(true);
         output->render->add_output_effect(&hook);
 
         return true;
     }
 
-    void update_pos_size()
+    void take_snapshot(wayfire_view view)
+    {
+        OpenGL::bind_context(output->render->ctx);
+        OpenGL::prepare_framebuffer(current_view.snapshot_fb, current_view.snapshot_tex);
+
+        GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, current_view.snapshot_fb));
+        GL_CALL(glClearColor(0, 0, 0, 0));
+        GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+
+        view->simple_render();
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    /* the size of the last buffer the client has committed */
+    void get_committed_size(wayfire_view view, int& w, int& h)
+    {
+        auto g = weston_desktop_surface_get_geometry(view->desktop_surface);
+        w = g.width;
+        h = g.height;
+    }
+
+    void render()
     {
-        int cx = GetProgress(current_view.original.x,
-                current_view.target.x, current_step, total_steps);
-        int cy = GetProgress(current_view.original.y,
-                current_view.target.y, current_step, total_steps);
-        int cw = GetProgress(current_view.original.width,
-                current_view.target.width, current_step, total_steps);
-        int ch = GetProgress(current_view.original.height,
-                current_view.target.height, current_step, total_steps);
-
-        current_view.view->set_geometry(cx, cy, cw, ch);
-
-        current_step++;
-        if (current_step == total_steps)
+        auto view = current_view.view;
+        auto& from = current_view.original;
+        auto& to = current_view.target;
+
+        float progress = duration.progress();
+        auto interpolate = [=] (int start, int end)
+        { return int(progress * end + (1 - progress) * start); };
+
+        weston_geometry r = {
+            interpolate(from.x, to.x), interpolate(from.y, to.y),
+            interpolate(from.width, to.width), interpolate(from.height, to.height)
+        };
+
+        int cw, ch;
+        get_committed_size(view, cw, ch);
+
+        /* if the client doesn't resize to the target(for ex. because of
+         * size hints), fade to whatever it has at the end of the movement */
+        if (!current_view.fading &&
+            ((cw == to.width && ch == to.height) || !duration.running()))
+        {
+            current_view.fading = true;
+            fade.start();
+        }
+
+        float alpha = current_view.fading ? fade.progress() : 0;
+        auto og = output->get_full_geometry();
+
+        if (alpha < 1)
         {
-            current_view.view->set_geometry(current_view.target);
-            current_view.view->set_moving(false);
-            current_view.view->set_resizing(false);
+            /* the whole snapshot is scaled, so that the part with the view
+             * ends up at r, the rest of it is transparent */
+            float sx = 1.0 * r.width / from.width, sy = 1.0 * r.height / from.height;
+            weston_geometry g = {
+                int(r.x - og.x - (from.x - og.x) * sx),
+                int(r.y - og.y - (from.y - og.y) * sy),
+                int(og.width * sx), int(og.height * sy)
+            };
+
+            OpenGL::use_default_program();
+            OpenGL::render_transformed_texture(current_view.snapshot_tex, g, {},
+                    glm::mat4(1.0), glm::vec4(1, 1, 1, 1 - alpha),
+                    TEXTURE_TRANSFORM_USE_DEVCOORD | TEXTURE_TRANSFORM_INVERT_Y);
+        }
+
+        if (alpha > 0 && cw > 0 && ch > 0)
+            render_view_at(view, r, cw, ch, alpha);
 
+        if (!duration.running() && !fade.running())
+        {
+            /* the size was requested when the animation started, resizing
+             * again would send a second configure and override the client */
+            view->move(to.x, to.y);
             stop_animation();
         }
     }
 
+    /* render the current contents of the view(with size w x h) scaled to r */
+    void render_view_at(wayfire_view view, weston_geometry r, int w, int h, float alpha)
+    {
+        auto og = output->get_full_geometry();
+
+        int cx = r.x + r.width  / 2 - og.x;
+        int cy = r.y + r.height / 2 - og.y;
+
+        float tx = (cx - og.width / 2 ) * 2. / og.width;
+        float ty = (og.height / 2 - cy) * 2. / og.height;
+
+        view->transform.translation = glm::translate(glm::mat4(1.0), {tx, ty, 0});
+        float sx = 1.0 * r.width / w, sy = 1.0 * r.height / h;
+        view->transform.scale = glm::scale(glm::mat4(1.0), {sx, sy, 1});
+        view->transform.color[3] = alpha;
+
+        /* the transform is applied around the center of the output */
+        auto compositor_geometry = view->geometry;
+        view->geometry.x = og.x + og.width  / 2 - w / 2;
+        view->geometry.y = og.y + og.height / 2 - h / 2;
+
+        view->simple_render(TEXTURE_TRANSFORM_USE_DEVCOORD);
+
+        view->geometry = compositor_geometry;
+        view->transform.translation = view->transform.scale = glm::mat4(1.0);
+        view->transform.color[3] = 0;
+    }
+
     void stop_animation()
     {
         output->render->auto_redraw(false);
         output->render->rem_effect(&hook);
+        output->render->reset_renderer();
+
+        current_view.view->transform.color[3] = 1;
+
+        OpenGL::bind_context(output->render->ctx);
+        GL_CALL(glDeleteTextures(1, &current_view.snapshot_tex));
+        GL_CALL(glDeleteFramebuffers(1, &current_view.snapshot_fb));
+        current_view.snapshot_tex = current_view.snapshot_fb = -1;
 
         grab_interface->ungrab();
         output->deactivate_plugin(grab_interface);
@@ -69,8 +69,8 @@ class wayfire_move : public wayfire_plugin_t
                 is_using_touch = false;
                 input_pressed(state);
             };
-            grab_interface->callbacks.pointer.motion = [=] (weston_pointer *ptr,
-                    weston_pointer_motion_event*)
+            grab_interface->callbacks.pointer.frame_motion = [=] (weston_pointer *ptr,
+                    wl_fixed_t, wl_fixed_t)
             {
                 input_motion(ptr->x, ptr->y);
             };
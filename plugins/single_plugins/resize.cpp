@@ -53,8 +53,8 @@ class wayfire_resize : public wayfire_plugin_t {
 
             input_pressed(s);
         };
-        grab_interface->callbacks.pointer.motion = [=] (weston_pointer *ptr,
-                weston_pointer_motion_event*)
+        grab_interface->callbacks.pointer.frame_motion = [=] (weston_pointer *ptr,
+                wl_fixed_t, wl_fixed_t)
         {
             input_motion(ptr->x, ptr->y);
         };
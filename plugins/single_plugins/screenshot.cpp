@@ -2,6 +2,14 @@
 #include <ctime>
 #include <sstream>
 #include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 
 #include <linux/input-event-codes.h>
 #include <compositor.h>
@@ -12,13 +20,320 @@
 #include <config.hpp>
 #include <render-manager.hpp>
 
+/* Native screen recorder. Every frame only the damaged rectangles are read back,
+ * asynchronously through a pair of pixel pack buffers, so that we never wait for
+ * the GPU. The rectangles are then handed to a worker thread, which XORs them
+ * against the previous contents and run-length encodes the result.
+ *
+ * File format (all values are 32-bit, native endianness):
+ * header:    "WFR1" width height
+ * per frame: msec nrects
+ * per rect:  x y w h nruns, followed by nruns pairs (length, xor value),
+ *            rows go from top to bottom
+ *
+ * The capture runs when the frame is complete(including the panels drawn by
+ * custom renderers). If writing the file fails, the recording stops */
+struct wf_recorder_frame
+{
+    uint32_t msec;
+    std::vector<pixman_box32_t> rects;
+    std::vector<uint32_t> pixels;
+};
+
+class wf_recorder
+{
+    struct pack_buffer
+    {
+        GLuint buffer = 0;
+        size_t size = 0, used = 0;
+        bool pending = false;
+        wf_recorder_frame frame;
+    } pbo[2];
+    int current_pbo = 0;
+
+    int width, height;
+    size_t max_queue;
+    std::chrono::steady_clock::time_point start_time;
+
+    /* damage of frames we had to drop, re-read with the next frame */
+    pixman_region32_t dropped_damage;
+    int dropped_frames = 0;
+
+    FILE *file;
+    std::thread encoder;
+    std::mutex queue_lock;
+    std::condition_variable queue_cv;
+    std::queue<wf_recorder_frame> queue;
+    bool stopping = false;
+    std::atomic<bool> write_failed{false};
+
+    /* only touched by the encoder thread */
+    std::vector<uint32_t> last_frame;
+
+    bool write_u32(uint32_t value)
+    {
+        return fwrite(&value, sizeof(value), 1, file) == 1;
+    }
+
+    /* returns false if writing failed */
+    bool encode_frame(const wf_recorder_frame& frame)
+    {
+        std::vector<uint32_t> runs;
+
+        if (!write_u32(frame.msec) || !write_u32(frame.rects.size()))
+            return false;
+
+        const uint32_t *data = frame.pixels.data();
+        for (auto& box : frame.rects)
+        {
+            int w = box.x2 - box.x1, h = box.y2 - box.y1;
+            runs.clear();
+
+            uint32_t run_value = 0, run_length = 0;
+            /* pixels were read bottom-up */
+            for (int j = h - 1; j >= 0; j--)
+            {
+                const uint32_t *row = data + j * w;
+                uint32_t *last = &last_frame[(box.y1 + h - 1 - j) * width + box.x1];
+
+                for (int i = 0; i < w; i++)
+                {
+                    uint32_t delta = row[i] ^ last[i];
+                    last[i] = row[i];
+
+                    if (run_length && delta == run_value)
+                    {
+                        ++run_length;
+                    } else
+                    {
+                        if (run_length)
+                        {
+                            runs.push_back(run_length);
+                            runs.push_back(run_value);
+                        }
+
+                        run_value = delta;
+                        run_length = 1;
+                    }
+                }
+            }
+
+            runs.push_back(run_length);
+            runs.push_back(run_value);
+
+            bool ok = write_u32(box.x1) && write_u32(box.y1) &&
+                write_u32(w) && write_u32(h) && write_u32(runs.size() / 2) &&
+                fwrite(runs.data(), sizeof(uint32_t), runs.size(), file) == runs.size();
+
+            if (!ok)
+                return false;
+
+            data += w * h;
+        }
+
+        return true;
+    }
+
+    void encoder_loop()
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(queue_lock);
+            queue_cv.wait(lock, [=] () { return stopping || !queue.empty(); });
+
+            if (queue.empty())
+                break;
+
+            auto frame = std::move(queue.front());
+            queue.pop();
+            lock.unlock();
+
+            if (!encode_frame(frame))
+            {
+                errio << "recorder: failed to write frame: " << strerror(errno)
+                    << ", stopping" << std::endl;
+                write_failed = true;
+                break;
+            }
+        }
+    }
+
+    void push_frame(wf_recorder_frame& frame)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_lock);
+            if (queue.size() < max_queue)
+            {
+                queue.push(std::move(frame));
+                queue_cv.notify_one();
+                return;
+            }
+        }
+
+        /* the disk can't keep up, drop the frame but remember what changed */
+        for (auto& box : frame.rects)
+        {
+            pixman_region32_union_rect(&dropped_damage, &dropped_damage, box.x1, box.y1,
+                                       box.x2 - box.x1, box.y2 - box.y1);
+        }
+        ++dropped_frames;
+    }
+
+    void collect(pack_buffer& pb)
+    {
+        if (!pb.pending)
+            return;
+
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.buffer));
+        auto data = (uint32_t*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pb.used, GL_MAP_READ_BIT);
+        if (data)
+        {
+            pb.frame.pixels.assign(data, data + pb.used / sizeof(uint32_t));
+            GL_CALL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+
+            push_frame(pb.frame);
+        } else
+        {
+            errio << "recorder: failed to map pixel buffer" << std::endl;
+        }
+
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        pb.frame = wf_recorder_frame();
+        pb.pending = false;
+    }
+
+    public:
+    wf_recorder(std::string name, int w, int h, int queue_size)
+        : width(w), height(h), max_queue(queue_size)
+    {
+        pixman_region32_init_rect(&dropped_damage, 0, 0, width, height);
+        start_time = std::chrono::steady_clock::now();
+
+        file = fopen(name.c_str(), "wb");
+        if (!file)
+        {
+            errio << "recorder: failed to open " << name << std::endl;
+            return;
+        }
+
+        if (fwrite("WFR1", 1, 4, file) != 4 || !write_u32(width) || !write_u32(height))
+        {
+            errio << "recorder: failed to write " << name << std::endl;
+            fclose(file);
+            file = nullptr;
+            return;
+        }
+
+        last_frame.resize(width * height, 0);
+        encoder = std::thread([=] () { encoder_loop(); });
+    }
+
+    bool is_valid()
+    {
+        return file != nullptr && !write_failed;
+    }
+
+    /* must be called from a post paint hook, with the output's GL context current */
+    void capture(render_manager *render)
+    {
+        pixman_region32_t damage;
+        pixman_region32_init(&damage);
+
+        render->get_frame_damage(&damage);
+        pixman_region32_union(&damage, &damage, &dropped_damage);
+        pixman_region32_intersect_rect(&damage, &damage, 0, 0, width, height);
+        pixman_region32_clear(&dropped_damage);
+
+        int n;
+        auto boxes = pixman_region32_rectangles(&damage, &n);
+
+        auto& pb = pbo[current_pbo];
+        size_t size = 0;
+        for (int i = 0; i < n; i++)
+            size += (boxes[i].x2 - boxes[i].x1) * (boxes[i].y2 - boxes[i].y1) * 4;
+
+        if (size > 0)
+        {
+            if (!pb.buffer)
+            {
+                GL_CALL(glGenBuffers(1, &pb.buffer));
+            }
+
+            GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+            GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.buffer));
+            if (pb.size < size)
+            {
+                GL_CALL(glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ));
+            }
+
+            size_t offset = 0;
+            for (int i = 0; i < n; i++)
+            {
+                int w = boxes[i].x2 - boxes[i].x1, h = boxes[i].y2 - boxes[i].y1;
+                GL_CALL(glReadPixels(boxes[i].x1, height - boxes[i].y2, w, h,
+                                     GL_RGBA, GL_UNSIGNED_BYTE, (void*) offset));
+                offset += w * h * 4;
+            }
+            GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+            pb.size = std::max(pb.size, size);
+            pb.used = size;
+            pb.frame.msec = std::chrono::duration_cast<std::chrono::milliseconds> (
+                std::chrono::steady_clock::now() - start_time).count();
+            pb.frame.rects.assign(boxes, boxes + n);
+            pb.pending = true;
+        }
+
+        pixman_region32_fini(&damage);
+
+        /* the other buffer was filled in the last frame, so its transfer
+         * should have finished by now */
+        current_pbo ^= 1;
+        collect(pbo[current_pbo]);
+    }
+
+    ~wf_recorder()
+    {
+        collect(pbo[current_pbo]);
+        collect(pbo[current_pbo ^ 1]);
+
+        if (file)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queue_lock);
+                stopping = true;
+                queue_cv.notify_one();
+            }
+
+            encoder.join();
+            if (fclose(file) != 0)
+                errio << "recorder: failed to finish the file: " << strerror(errno) << std::endl;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (pbo[i].buffer)
+            {
+                GL_CALL(glDeleteBuffers(1, &pbo[i].buffer));
+            }
+        }
+
+        if (dropped_frames)
+            info << "recorder: dropped " << dropped_frames << " frames" << std::endl;
+
+        pixman_region32_fini(&dropped_damage);
+    }
+};
+
 class wayfire_screenshot : public wayfire_plugin_t {
     key_callback screenshot, record;
-    effect_hook_t hook;
+    effect_hook_t hook, record_hook;
 
-    weston_recorder *w_recorder = NULL;
+    wf_recorder *recorder = nullptr;
+    int record_queue_size;
 
-    std::string path;
+    std::string path, format;
+    bool fast_save;
 
 
     std::string get_current_name(std::string prefix, std::string suffix)
@@ -47,6 +362,8 @@ class wayfire_screenshot : public wayfire_plugin_t {
 
             auto default_path = std::string(secure_getenv("HOME")) + "/Pictures/";
             path = section->get_string("save_path", default_path);
+            format = section->get_string("format", "png");
+            fast_save = section->get_int("fast_save", 0);
 
             hook = std::bind(std::mem_fn(&wayfire_screenshot::save_screenshot), this);
             screenshot = [=] (weston_keyboard*, uint32_t)
@@ -56,7 +373,7 @@ class wayfire_screenshot : public wayfire_plugin_t {
                     return;
                 output->deactivate_plugin(grab_interface);
 
-                output->render->add_output_effect(&hook);
+                output->render->add_post_paint_hook(&hook);
                 weston_output_schedule_repaint(output->handle);
             };
             output->add_key(key.mod, key.keyval, &screenshot);
@@ -65,26 +382,69 @@ class wayfire_screenshot : public wayfire_plugin_t {
             if (key.keyval == 0)
                 return;
 
+            record_queue_size = section->get_int("record_max_queue", 16);
+            record_hook = [=] ()
+            {
+                if (recorder->is_valid())
+                    recorder->capture(output->render);
+                else
+                    stop_recording();
+            };
+
             record = [=] (weston_keyboard*, uint32_t)
             {
-                if (w_recorder)
+                if (recorder)
                 {
-                    weston_recorder_stop(w_recorder);
-                    w_recorder = NULL;
+                    stop_recording();
                 } else
                 {
-                    w_recorder =
-                        weston_recorder_start(output->handle,
-                                              get_current_name("record", "wcap").c_str());
+                    if (!output->activate_plugin(grab_interface))
+                        return;
+                    output->deactivate_plugin(grab_interface);
+
+                    start_recording();
                 }
             };
             output->add_key(key.mod, key.keyval, &record);
 
         }
 
+        void start_recording()
+        {
+            auto geometry = output->get_full_geometry();
+            recorder = new wf_recorder(get_current_name("record", "wfrec"),
+                                       geometry.width, geometry.height,
+                                       record_queue_size);
+
+            if (!recorder->is_valid())
+            {
+                delete recorder;
+                recorder = nullptr;
+                return;
+            }
+
+            output->render->add_post_paint_hook(&record_hook);
+            weston_output_damage(output->handle);
+        }
+
+        void stop_recording()
+        {
+            output->render->rem_post_paint_hook(&record_hook);
+
+            OpenGL::bind_context(output->render->ctx);
+            delete recorder;
+            recorder = nullptr;
+        }
+
+        void fini()
+        {
+            if (recorder)
+                stop_recording();
+        }
+
         void save_screenshot()
         {
-            output->render->rem_effect(&hook);
+            output->render->rem_post_paint_hook(&hook);
 
             auto geometry = output->get_full_geometry();
             uint8_t *pixels = new uint8_t[geometry.width * geometry.height * 4];
@@ -92,8 +452,9 @@ class wayfire_screenshot : public wayfire_plugin_t {
             GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
             GL_CALL(glReadPixels(0, 0, geometry.width, geometry.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
 
-            image_io::write_to_file(get_current_name("screenshot", "png"), pixels,
-                    geometry.width, geometry.height, "png");
+            image_io::write_to_file(get_current_name("screenshot", format), pixels,
+                    geometry.width, geometry.height, format, fast_save);
+            delete[] pixels;
         }
 };
 
@@ -4,17 +4,13 @@
 #include <view.hpp>
 #include <render-manager.hpp>
 #include <workspace-manager.hpp>
+#include <animation.hpp>
 
 #include <queue>
 #include <linux/input-event-codes.h>
 #include <algorithm>
 #include "../../shared/config.hpp"
 
-struct duple
-{
-    float start, end;
-};
-
 enum paint_attribs
 {
     UPDATE_SCALE = 1,
@@ -25,8 +21,8 @@ enum paint_attribs
 struct view_paint_attribs
 {
     wayfire_view view;
-    duple scale_x, scale_y, off_x, off_y, off_z;
-    duple rot;
+    wf_transition scale_x, scale_y, off_x, off_y, off_z;
+    wf_transition rot;
 
     uint32_t updates;
 };
@@ -95,7 +91,7 @@ class view_switcher : public wayfire_plugin_t
 
     size_t current_view_index;
 
-    int max_steps, current_step, initial_animation_steps;
+    wf_duration duration, initial_animation;
 
     struct
     {
@@ -132,8 +128,9 @@ class view_switcher : public wayfire_plugin_t
         if (fast_switch_key.keyval)
             output->add_key(fast_switch_key.mod, fast_switch_key.keyval, &fast_switch_binding);
 
-        max_steps = section->get_duration("duration", 30);
-        initial_animation_steps = section->get_duration("initial_animation", 5);;
+        duration = wf_duration(output, section->get_duration("duration", 480));
+        initial_animation = wf_duration(output,
+                section->get_duration("initial_animation", 80));
         view_scale_config = section->get_double("view_thumbnail_size", 0.4);
 
         activate_key = section->get_key("activate", {MODIFIER_ALT, KEY_TAB});
@@ -239,6 +236,20 @@ class view_switcher : public wayfire_plugin_t
         }
     }
 
+    /* the background drawn by the compositor isn't a view, so it can't be
+     * pushed back, it is drawn flat behind everything instead */
+    void render_builtin_background()
+    {
+        auto projection = wayfire_view_transform::global_view_projection;
+        wayfire_view_transform::global_view_projection = glm::mat4(1.0);
+
+        GL_CALL(glDepthMask(GL_FALSE));
+        output->workspace->render_background(nullptr, 0);
+        GL_CALL(glDepthMask(GL_TRUE));
+
+        wayfire_view_transform::global_view_projection = projection;
+    }
+
     void push_exit()
     {
         if (state.in_rotate || state.in_fold || state.in_unfold)
@@ -417,6 +428,9 @@ class view_switcher : public wayfire_plugin_t
         {
             bg->transform.color = glm::vec4(0.7, 0.7, 0.7, 1.0);
             bg->render(0);
+        } else
+        {
+            render_builtin_background();
         }
         for(int i = active_views.size() - 1; i >= 0; i--)
             render_view(active_views[i].view);
@@ -437,7 +451,7 @@ class view_switcher : public wayfire_plugin_t
         GetTuple(sw, sh, output->get_screen_size());
         active_views.clear();
         state.in_fold = true;
-        current_step = 0;
+        initial_animation.start();
 
         update_views();
         for (size_t i = current_view_index, cnt = 0; cnt < views.size(); ++cnt, i = (i + 1) % views.size())
@@ -472,28 +486,28 @@ class view_switcher : public wayfire_plugin_t
         }
     }
 
-    void update_view_transforms(int step, int maxstep)
+    void update_view_transforms(wf_duration& animation)
     {
         for (auto v : active_views)
         {
             if (v.updates & UPDATE_OFFSET)
             {
                 v.view->transform.translation = glm::translate(glm::mat4(1.0), glm::vec3(
-                            GetProgress(v.off_x.start, v.off_x.end, step, maxstep),
-                            GetProgress(v.off_y.start, v.off_y.end, step, maxstep),
-                            GetProgress(v.off_z.start, v.off_z.end, step, maxstep)));
+                            animation.progress(v.off_x),
+                            animation.progress(v.off_y),
+                            animation.progress(v.off_z)));
             }
             if (v.updates & UPDATE_SCALE)
             {
                 v.view->transform.scale = glm::scale(glm::mat4(1.0), glm::vec3(
-                            GetProgress(v.scale_x.start, v.scale_x.end, step, maxstep),
-                            GetProgress(v.scale_y.start, v.scale_y.end, step, maxstep),
+                            animation.progress(v.scale_x),
+                            animation.progress(v.scale_y),
                             1));
             }
             if (v.updates & UPDATE_ROTATION)
             {
                 v.view->transform.rotation = glm::rotate(glm::mat4(1.0),
-                        GetProgress(v.rot.start, v.rot.end, step, maxstep),
+                        animation.progress(v.rot),
                         glm::vec3(0, 1, 0));
             }
         }
@@ -519,10 +533,9 @@ class view_switcher : public wayfire_plugin_t
 
     void update_fold()
     {
-        ++current_step;
-        update_view_transforms(current_step, initial_animation_steps);
+        update_view_transforms(initial_animation);
 
-        if(current_step == initial_animation_steps)
+        if (!initial_animation.running())
         {
             for (auto &v : active_views)
                 v.view->transform.translation = glm::mat4(1.0);
@@ -543,7 +556,7 @@ class view_switcher : public wayfire_plugin_t
     void start_unfold()
     {
         state.in_unfold = true;
-        current_step = 0;
+        duration.start();
 
         active_views.clear();
 
@@ -603,10 +616,9 @@ class view_switcher : public wayfire_plugin_t
 
     void update_unfold()
     {
-        ++current_step;
-        update_view_transforms(current_step, max_steps);
+        update_view_transforms(duration);
 
-        if (current_step == max_steps)
+        if (!duration.running())
         {
             state.in_unfold = false;
             if (!state.reversed_folds)
@@ -627,7 +639,6 @@ class view_switcher : public wayfire_plugin_t
             return;
 
         state.in_rotate = true;
-        current_step = 0;
 
         current_view_index    = (current_view_index + dir + sz) % sz;
         output->bring_to_front(views[current_view_index]);
@@ -693,15 +704,14 @@ class view_switcher : public wayfire_plugin_t
             elem.updates = UPDATE_ROTATION | UPDATE_OFFSET;
         }
 
-        current_step = 0;
+        duration.start();
     }
 
     void update_rotate()
     {
-        ++current_step;
-        update_view_transforms(current_step, max_steps);
+        update_view_transforms(duration);
 
-        if (current_step == max_steps)
+        if (!duration.running())
         {
             state.in_rotate = false;
             dequeue_next_action();
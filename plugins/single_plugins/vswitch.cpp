@@ -3,9 +3,12 @@
 #include <view.hpp>
 #include <workspace-manager.hpp>
 #include <render-manager.hpp>
+#include <animation.hpp>
+#include <opengl.hpp>
 #include <queue>
 #include <linux/input.h>
 #include <utility>
+#include <cmath>
 #include "../../shared/config.hpp"
 #include "view-change-viewport-signal.hpp"
 
@@ -34,9 +37,19 @@ class vswitch : public wayfire_plugin_t
         touch_gesture_callback gesture_cb;
 
         std::queue<switch_direction> dirs; // series of moves we have to do
-        int current_step = 0, max_step;
+        wf_duration duration;
         bool running = false;
-        effect_hook_t hook;
+
+        /* the views aren't moved during the slide, instead the workspace we
+         * leave and the one we go to are rendered to streams[0] and streams[1]
+         * and the streams slide over the output */
+        wf_workspace_stream streams[2];
+        render_hook_t renderer;
+        signal_callback_t output_resized;
+
+        int slide_dx, slide_dy;
+        /* the view which is taken to the next workspace, it stays in place */
+        wayfire_view static_view;
     public:
 
     void init(wayfire_config *config) {
@@ -114,8 +127,22 @@ class vswitch : public wayfire_plugin_t
         };
         output->add_gesture(activation_gesture, &gesture_cb);
 
-        max_step = section->get_duration("duration", 15);
-        hook = std::bind(std::mem_fn(&vswitch::slide_update), this);
+        duration = wf_duration(output, section->get_duration("duration", 240));
+        renderer = std::bind(std::mem_fn(&vswitch::render), this);
+
+        for (auto& stream : streams)
+            stream.fbuff = stream.tex = -1;
+
+        output_resized = [=] (signal_data*)
+        {
+            for (auto& stream : streams)
+            {
+                GL_CALL(glDeleteTextures(1, &stream.tex));
+                GL_CALL(glDeleteFramebuffers(1, &stream.fbuff));
+                stream.tex = stream.fbuff = -1;
+            }
+        };
+        output->connect_signal("output-resized", &output_resized);
     }
 
     void add_direction(int dx, int dy, wayfire_view view = nullptr) {
@@ -131,28 +158,82 @@ class vswitch : public wayfire_plugin_t
             slide_done();
     }
 
-    float sx, sy, tx, ty;
+    glm::mat4 get_output_matrix()
+    {
+        float angle = 0;
+        switch(output->get_transform()) {
+            case WL_OUTPUT_TRANSFORM_90:
+                angle = 3 * M_PI / 2;
+                break;
+            case WL_OUTPUT_TRANSFORM_180:
+                angle = M_PI;
+                break;
+            case WL_OUTPUT_TRANSFORM_270:
+                angle = M_PI / 2;
+                break;
+            default:
+                break;
+        }
 
-    struct animating_view {
-        wayfire_view v;
-        int ox, oy;
-    };
-    std::vector<animating_view> views;
+        return glm::rotate(glm::mat4(1.0), angle, glm::vec3(0, 0, 1));
+    }
 
-    void slide_update()
+    void render()
     {
-        ++current_step;
-        float dx = GetProgress(sx, tx, current_step, max_step);
-        float dy = GetProgress(sy, ty, current_step, max_step);
+        for (auto& stream : streams)
+        {
+            if (!stream.running)
+                output->render->workspace_stream_start(&stream);
+            else
+                output->render->workspace_stream_update(&stream);
+        }
 
-        /* XXX: Possibly apply transform in custom rendering? */
-        for (auto v : views)
-            v.v->move(v.ox + dx, v.oy + dy);
+        GetTuple(w, h, output->get_screen_size());
+        float progress = duration.progress();
+        auto matrix = get_output_matrix();
 
-        if (current_step == max_step)
+        OpenGL::use_default_program();
+        OpenGL::use_device_viewport();
+
+        for (int i = 0; i < 2; i++)
+        {
+            weston_geometry g = {
+                int((i - progress) * slide_dx * w),
+                int((i - progress) * slide_dy * h),
+                w, h
+            };
+
+            OpenGL::texture_geometry texg;
+            texg.x1 = texg.y1 = 0;
+            texg.x2 = streams[i].scale_x;
+            texg.y2 = streams[i].scale_y;
+
+            OpenGL::render_transformed_texture(streams[i].tex, g, texg, matrix,
+                    glm::vec4(1), TEXTURE_TRANSFORM_USE_DEVCOORD |
+                    TEXTURE_TRANSFORM_INVERT_Y | TEXTURE_USE_TEX_GEOMETRY);
+        }
+
+        /* it is hidden in the streams and drawn on top of them instead */
+        if (static_view)
+        {
+            static_view->transform.color[3] = 1;
+            static_view->simple_render(TEXTURE_TRANSFORM_USE_DEVCOORD);
+            static_view->transform.color[3] = 0;
+        }
+
+        if (!duration.running())
             slide_done();
     }
 
+    void stop_streams()
+    {
+        for (auto& stream : streams)
+        {
+            if (stream.running)
+                output->render->workspace_stream_stop(&stream);
+        }
+    }
+
     void slide_done()
     {
         auto front = dirs.front();
@@ -166,14 +247,9 @@ class vswitch : public wayfire_plugin_t
         vx += dx;
         vy += dy;
 
-        for (auto v : views)
-        {
-            v.v->move(v.ox, v.oy);
-            v.v->set_moving(false);
-        }
-
         output->workspace->set_workspace(std::make_tuple(vx, vy));
 
+        /* the only change to the views' geometry during the whole slide */
         auto output_g = output->get_full_geometry();
         if (front.view)
         {
@@ -189,20 +265,24 @@ class vswitch : public wayfire_plugin_t
             output->emit_signal("view-change-viewport", &data);
         }
 
-        views.clear();
+        stop_streams();
 
         if (dirs.size() == 0) {
             stop_switch();
             return;
         }
 
-        current_step = 0;
+        duration.start();
         dx = dirs.front().dx, dy = dirs.front().dy;
-        wayfire_view static_view = front.view;
 
-        sx = sy = 0;
-        tx = -dx * output->handle->width;
-        ty = -dy * output->handle->height;
+        if (static_view != front.view)
+        {
+            if (static_view)
+                static_view->transform.color[3] = 1;
+            static_view = front.view;
+            if (static_view)
+                static_view->transform.color[3] = 0;
+        }
 
         GetTuple(vwidth, vheight, output->workspace->get_workspace_grid_size());
         if (vx + dx < 0 || vx + dx >= vwidth || vy + dy < 0 || vy + dy >= vheight) {
@@ -210,26 +290,22 @@ class vswitch : public wayfire_plugin_t
             return;
         }
 
-        auto current_views = output->workspace->get_views_on_workspace(
-                output->workspace->get_current_workspace());
-        auto next_views = output->workspace->get_views_on_workspace(std::make_tuple(vx + dx, vy + dy));
+        slide_dx = dx;
+        slide_dy = dy;
+        streams[0].ws = output->workspace->get_current_workspace();
+        streams[1].ws = std::make_tuple(vx + dx, vy + dy);
+
+        auto current_views = output->workspace->get_views_on_workspace(streams[0].ws);
+        auto next_views = output->workspace->get_views_on_workspace(streams[1].ws);
 
-        std::unordered_set<wayfire_view> views_to_move;
+        bool empty = true;
         for (auto view : current_views)
-            views_to_move.insert(view);
+            empty &= (view == static_view);
         for (auto view : next_views)
-            views_to_move.insert(view);
-
-        for (auto view : views_to_move) {
-            if (view->is_mapped && !view->destroyed && view != static_view)
-            {
-                view->set_moving(true);
-                views.push_back({view, view->geometry.x, view->geometry.y});
-            }
-        }
+            empty &= (view == static_view);
 
         /* both workspaces are empty, so no animation, just switch */
-        if (views_to_move.empty())
+        if (empty)
             slide_done();
     }
 
@@ -241,7 +317,7 @@ class vswitch : public wayfire_plugin_t
         }
 
         running = true;
-        output->render->add_output_effect(&hook, nullptr);
+        output->render->set_renderer(renderer);
         output->render->auto_redraw(true);
 
         return true;
@@ -252,7 +328,13 @@ class vswitch : public wayfire_plugin_t
         output->deactivate_plugin(grab_interface);
         dirs = std::queue<switch_direction> ();
         running = false;
-        output->render->rem_effect(&hook, nullptr);
+
+        if (static_view)
+            static_view->transform.color[3] = 1;
+        static_view = nullptr;
+
+        stop_streams();
+        output->render->reset_renderer();
         output->render->auto_redraw(false);
     }
 };
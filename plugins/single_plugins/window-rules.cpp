@@ -1,8 +1,12 @@
 #include <output.hpp>
 #include <view.hpp>
 #include <config.hpp>
+#include <algorithm>
 #include <cwctype>
 #include <cstdio>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
 #include <signal-definitions.hpp>
 
 /*
@@ -47,133 +51,185 @@ static bool ends_with(string x, string y)
 }
 
 
-class wayfire_window_rules : public wayfire_plugin_t
+/* Aho-Corasick automaton for the "contains" predicates. All patterns of
+ * a field are searched for in one pass over the string, independently
+ * of how many rules there are */
+class wf_multi_pattern_matcher
 {
+    struct node
+    {
+        int next[256];
+        /* rules whose pattern ends here, including those of the fail links */
+        std::vector<size_t> rules;
+    };
 
+    std::vector<node> nodes;
 
-    using verification_func = std::function<bool(wayfire_view, std::string)>;
+    int add_node()
+    {
+        nodes.emplace_back();
+        std::fill(nodes.back().next, nodes.back().next + 256, -1);
+        return nodes.size() - 1;
+    }
 
-    struct verificator
+    public:
+    wf_multi_pattern_matcher()
     {
-        verification_func func;
-        std::string atom;
-    };
+        add_node();
+    }
 
-    std::vector<verificator> verficators =
+    void add_pattern(const std::string& pattern, size_t rule)
     {
-        {  [] (wayfire_view view, std::string match) -> bool
-            {
-                auto c_title = weston_desktop_surface_get_title (view->desktop_surface);
-                std::string title = c_title ? c_title : "(null)";
-                return title.find(match) != std::string::npos;
-            },
-            "title contains"
-        },
-        { [] (wayfire_view view, std::string match) -> bool
-            {
-                auto c_title = weston_desktop_surface_get_title (view->desktop_surface);
-                std::string title = c_title ? c_title : "(null)";
-                return title == match;
-            },
-            "title"
-        },
-        {  [] (wayfire_view view, std::string match) -> bool
-            {
-                auto c_app_id = weston_desktop_surface_get_app_id (view->desktop_surface);
-                std::string app_id = c_app_id ? c_app_id : "(null)";
-
-                return app_id.find(match) != std::string::npos;
-            },
-            "app-id contains"
-        },
-        {  [] (wayfire_view view, std::string match) -> bool
+        int cur = 0;
+        for (unsigned char c : pattern)
+        {
+            if (nodes[cur].next[c] < 0)
             {
-                auto c_app_id = weston_desktop_surface_get_app_id (view->desktop_surface);
-                std::string app_id = c_app_id ? c_app_id : "(null)";
-                return app_id == match;
-            },
-            "app-id"
-        },
-    };
-
-    std::vector<std::string> events = {
-        "created", "destroyed", "maximized", "fullscreened"
-    };
+                int n = add_node();
+                nodes[cur].next[c] = n;
+            }
 
-    using action_func = std::function<void(wayfire_view view)>;
+            cur = nodes[cur].next[c];
+        }
 
-    struct lambda_executor
-    {
-        verification_func verify;
-        std::string verification_string;
-        action_func action;
-    };
+        nodes[cur].rules.push_back(rule);
+    }
 
-    using rule_func = std::function<void(wayfire_view)>;
-    struct rule
+    /* turns the trie into a DFA, must be called after all patterns are added */
+    void compile()
     {
-        std::string signal;
-        std::function<void(wayfire_view)> func;
-    };
+        std::vector<int> fail(nodes.size(), 0);
+        std::queue<int> q;
 
-    rule parse_add_rule(std::string rule)
-    {
-        std::string predicate, action;
-        struct rule result;
-
-        size_t pos = 0;
-        for (; pos < rule.size() - 2; ++pos)
+        for (int c = 0; c < 256; c++)
         {
-            if (rule[pos] == '-' && rule[pos + 1] == '>')
-                break;
+            int n = nodes[0].next[c];
+            if (n < 0)
+            {
+                nodes[0].next[c] = 0;
+            } else
+            {
+                fail[n] = 0;
+                q.push(n);
+            }
         }
 
-        /* first condition is so that there is no underflow in unsigned arithmetic */
-        if (rule.size() <= 5 || pos >= rule.size() - 2 || pos < 1)
-            return result;
+        while (!q.empty())
+        {
+            int cur = q.front();
+            q.pop();
 
-        predicate = trim(rule.substr(0, pos));
-        std::string event;
-        action = trim(rule.substr(pos + 2, rule.size() - pos - 1));
+            auto& inherited = nodes[fail[cur]].rules;
+            nodes[cur].rules.insert(nodes[cur].rules.end(), inherited.begin(), inherited.end());
 
-        for (auto ev : events)
-        {
-            if (ends_with(predicate, ev))
+            for (int c = 0; c < 256; c++)
             {
-                event = ev;
-                predicate = trim(predicate.substr(0, predicate.length() - ev.length()));
-                break;
+                int n = nodes[cur].next[c];
+                if (n < 0)
+                {
+                    nodes[cur].next[c] = nodes[fail[cur]].next[c];
+                } else
+                {
+                    fail[n] = nodes[fail[cur]].next[c];
+                    q.push(n);
+                }
             }
         }
+    }
 
-        lambda_executor exec;
-        exec.verify = nullptr;
-        exec.action = nullptr;
+    bool empty()
+    {
+        return nodes.size() == 1 && nodes[0].rules.empty();
+    }
+
+    void match(const std::string& text, std::vector<bool>& matched)
+    {
+        /* the empty pattern is contained in everything */
+        for (auto r : nodes[0].rules)
+            matched[r] = true;
 
-        for (const auto& pred : verficators)
+        int cur = 0;
+        for (unsigned char c : text)
         {
-            if (starts_with(predicate, pred.atom))
-            {
-                exec.verify = pred.func;
-                exec.verification_string =
-                    trim(predicate.substr(pred.atom.length(),
-                                          predicate.length() - pred.atom.length()));
-                break;
-            }
+            cur = nodes[cur].next[c];
+            for (auto r : nodes[cur].rules)
+                matched[r] = true;
         }
+    }
+};
+
+/* the matches of a view, valid while its title and app-id don't change */
+struct wf_window_rules_cache : public wf_custom_view_data
+{
+    std::string title, app_id;
+    std::vector<bool> matched;
+};
+
+#define window_rules_data "__window_rules"
+
+class wayfire_window_rules : public wayfire_plugin_t
+{
+    enum rule_field
+    {
+        FIELD_TITLE  = 0,
+        FIELD_APP_ID = 1,
+        FIELD_COUNT
+    };
+
+    struct rule_predicate
+    {
+        std::string atom;
+        rule_field field;
+        bool contains;
+    };
+
+    /* the longer atoms must come first */
+    std::vector<rule_predicate> predicates =
+    {
+        {"title contains",  FIELD_TITLE,  true},
+        {"title",           FIELD_TITLE,  false},
+        {"app-id contains", FIELD_APP_ID, true},
+        {"app-id",          FIELD_APP_ID, false},
+    };
+
+    enum rule_event
+    {
+        EVENT_CREATED      = 0,
+        EVENT_DESTROYED    = 1,
+        EVENT_MAXIMIZED    = 2,
+        EVENT_FULLSCREENED = 3,
+        EVENT_COUNT
+    };
+
+    std::vector<std::string> events = {
+        "created", "destroyed", "maximized", "fullscreened"
+    };
+
+    using action_func = std::function<void(wayfire_view view)>;
+
+    /* the rules are compiled into one matcher per field: an automaton for
+     * the "contains" patterns and a hash table for the exact ones */
+    struct field_matcher
+    {
+        wf_multi_pattern_matcher contains;
+        std::unordered_map<std::string, std::vector<size_t>> exact;
+    } matchers[FIELD_COUNT];
 
-        if (!exec.verify || !event.length())
-            return result;
+    std::vector<action_func> actions;
+    /* the rules for each event, in the order of the config file */
+    std::vector<size_t> rules_by_event[EVENT_COUNT];
 
+    action_func parse_action(std::string action)
+    {
         if (starts_with(action, "move"))
         {
             int x, y;
             int t = std::sscanf(action.c_str(), "move %d %d", &x, &y);
 
             if (t != 2)
-                return result;
+                return nullptr;
 
-            exec.action = [x,y] (wayfire_view view) {
+            return [x,y] (wayfire_view view) {
                 auto og = view->output->get_full_geometry();
                 view->move(og.x + x, og.y + y);
             };
@@ -183,9 +239,9 @@ class wayfire_window_rules : public wayfire_plugin_t
             int t = std::sscanf(action.c_str(), "resize %d %d", &w, &h);
 
             if (t != 2 || w <= 0 || h <= 0)
-                return result;
+                return nullptr;
 
-            exec.action = [w,h] (wayfire_view view) mutable {
+            return [w,h] (wayfire_view view) mutable {
                 GetTuple(sw, sh, view->output->get_screen_size());
                 if (w > 100000)
                     w = sw;
@@ -195,7 +251,7 @@ class wayfire_window_rules : public wayfire_plugin_t
             };
         } else if (ends_with(action, "set maximized"))
         {
-            exec.action = [action] (wayfire_view view)
+            return [action] (wayfire_view view)
             {
                 view_maximized_signal data;
                 data.view = view;
@@ -206,7 +262,7 @@ class wayfire_window_rules : public wayfire_plugin_t
 
         else if (ends_with(action, "set fullscreen"))
         {
-            exec.action = [action] (wayfire_view view)
+            return [action] (wayfire_view view)
             {
                 view_fullscreen_signal data;
                 data.view = view;
@@ -215,41 +271,150 @@ class wayfire_window_rules : public wayfire_plugin_t
             };
         }
 
+        return nullptr;
+    }
 
-        if (!exec.action)
-            return result;
+    void parse_add_rule(std::string rule)
+    {
+        std::string predicate, action;
 
-        result.signal = event;
-        result.func = [exec] (wayfire_view view)
+        size_t pos = 0;
+        for (; pos < rule.size() - 2; ++pos)
         {
-            if (exec.verify(view, exec.verification_string))
-                exec.action(view);
-        };
+            if (rule[pos] == '-' && rule[pos + 1] == '>')
+                break;
+        }
+
+        /* first condition is so that there is no underflow in unsigned arithmetic */
+        if (rule.size() <= 5 || pos >= rule.size() - 2 || pos < 1)
+            return;
 
-        return result;
+        predicate = trim(rule.substr(0, pos));
+        int event = -1;
+        action = trim(rule.substr(pos + 2, rule.size() - pos - 1));
+
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if (ends_with(predicate, events[i]))
+            {
+                event = i;
+                predicate = trim(predicate.substr(0, predicate.length() - events[i].length()));
+                break;
+            }
+        }
+
+        const rule_predicate *pred = nullptr;
+        std::string pattern;
+        for (const auto& p : predicates)
+        {
+            if (starts_with(predicate, p.atom))
+            {
+                pred = &p;
+                pattern = trim(predicate.substr(p.atom.length(),
+                            predicate.length() - p.atom.length()));
+                break;
+            }
+        }
+
+        if (!pred || event < 0)
+            return;
+
+        auto func = parse_action(action);
+        if (!func)
+            return;
+
+        size_t idx = actions.size();
+        actions.push_back(func);
+        rules_by_event[event].push_back(idx);
+
+        auto& matcher = matchers[pred->field];
+        if (pred->contains)
+            matcher.contains.add_pattern(pattern, idx);
+        else
+            matcher.exact[pattern].push_back(idx);
     }
 
-    signal_callback_t created, destroyed, maximized, fullscreened;
+    static const char *get_field(wayfire_view view, rule_field field)
+    {
+        const char *value = field == FIELD_TITLE ?
+            weston_desktop_surface_get_title(view->desktop_surface) :
+            weston_desktop_surface_get_app_id(view->desktop_surface);
+
+        return value ? value : "(null)";
+    }
+
+    void match_field(rule_field field, const std::string& value, std::vector<bool>& matched)
+    {
+        auto& matcher = matchers[field];
+        if (!matcher.contains.empty())
+            matcher.contains.match(value, matched);
+
+        auto it = matcher.exact.find(value);
+        if (it != matcher.exact.end())
+        {
+            for (auto r : it->second)
+                matched[r] = true;
+        }
+    }
+
+    /* the rules which match the view, recomputed only if its title or app-id changed */
+    const std::vector<bool>& get_matches(wayfire_view view)
+    {
+        auto& data = view->custom_data[window_rules_data];
+        if (!data)
+            data = new wf_window_rules_cache;
+
+        auto cache = static_cast<wf_window_rules_cache*> (data);
+
+        /* compared without copying, the strings are copied only if they changed */
+        auto title = get_field(view, FIELD_TITLE);
+        auto app_id = get_field(view, FIELD_APP_ID);
+        if (cache->matched.size() == actions.size() &&
+                cache->title == title && cache->app_id == app_id)
+            return cache->matched;
 
-    std::map<std::string, std::vector<rule_func>> rules_list;
+        cache->title = title;
+        cache->app_id = app_id;
+        cache->matched.assign(actions.size(), false);
+
+        match_field(FIELD_TITLE, cache->title, cache->matched);
+        match_field(FIELD_APP_ID, cache->app_id, cache->matched);
+
+        return cache->matched;
+    }
+
+    void run_rules(rule_event event, wayfire_view view)
+    {
+        if (rules_by_event[event].empty())
+            return;
+
+        /* a copy, the actions can trigger other events which update the cache */
+        auto matched = get_matches(view);
+        for (auto r : rules_by_event[event])
+        {
+            if (matched[r])
+                actions[r](view);
+        }
+    }
+
+    signal_callback_t created, destroyed, maximized, fullscreened;
 
     public:
     void init(wayfire_config *config)
     {
         auto section = config->get_section("window-rules");
         for (auto opt : section->options)
-        {
-            auto rule = parse_add_rule(opt.second);
-            rules_list[rule.signal].push_back(rule.func);
-        }
+            parse_add_rule(opt.second);
+
+        for (auto& matcher : matchers)
+            matcher.contains.compile();
 
         created = [=] (signal_data *data)
         {
             auto conv = static_cast<create_view_signal*> (data);
             assert(data);
 
-            for (const auto& rule : rules_list["created"])
-                rule(conv->created_view);
+            run_rules(EVENT_CREATED, conv->created_view);
         };
         output->connect_signal("create-view", &created);
 
@@ -258,8 +423,7 @@ class wayfire_window_rules : public wayfire_plugin_t
             auto conv = static_cast<destroy_view_signal*> (data);
             assert(data);
 
-            for (const auto& rule : rules_list["destroyed"])
-                rule(conv->destroyed_view);
+            run_rules(EVENT_DESTROYED, conv->destroyed_view);
         };
         output->connect_signal("destroy-view", &destroyed);
 
@@ -271,8 +435,7 @@ class wayfire_window_rules : public wayfire_plugin_t
             if (!conv->state)
                 return;
 
-            for (const auto& rule : rules_list["maximized"])
-                rule(conv->view);
+            run_rules(EVENT_MAXIMIZED, conv->view);
         };
         output->connect_signal("view-maximized", &maximized);
 
@@ -284,8 +447,7 @@ class wayfire_window_rules : public wayfire_plugin_t
             if (!conv->state)
                 return;
 
-            for (const auto& rule : rules_list["fullscreened"])
-                rule(conv->view);
+            run_rules(EVENT_FULLSCREENED, conv->view);
         };
         output->connect_signal("view-fullscreen", &fullscreened);
     }
@@ -6,8 +6,16 @@
 #include <signal-definitions.hpp>
 #include <pixman-1/pixman.h>
 #include <opengl.hpp>
+#include <config.h>
+#include <render-manager.hpp>
+#include <animation.hpp>
+#include <map>
 #include "proto/wayfire-shell-server.h"
 
+#if BUILD_WITH_IMAGEIO
+#include <img.hpp>
+#endif
+
 struct wf_default_workspace_implementation : wf_workspace_implementation
 {
     bool view_movable (wayfire_view view)  { return true; }
@@ -35,8 +43,35 @@ class viewport_manager : public workspace_manager
 
         std::vector<std::vector<wf_workspace_implementation*>> implementation;
 
+        /* the built-in background, drawn by us instead of a shell surface.
+         * Until the image is loaded(or if there is none), a solid color is used */
+        bool builtin_background = false;
+        wayfire_color background_color;
+        GLuint background_color_tex = -1;
+#if BUILD_WITH_IMAGEIO
+        image_io::async_texture_ptr background_image;
+#endif
+
         wf_default_workspace_implementation default_implementation;
 
+        /* panels slided by the compositor(animate_panel). The view is
+         * moved to its final position immediately, the transform holds the
+         * offset to where it is currently drawn */
+        struct panel_animation
+        {
+            weston_transform transform;
+            int dx, dy;
+            wf_duration duration;
+        };
+
+        std::map<wayfire_view, panel_animation> panel_animations;
+        effect_hook_t panel_animation_hook;
+        bool panel_hook_active = false;
+
+        void set_panel_offset(wayfire_view view, panel_animation& anim, float progress);
+        void stop_panel_animation(wayfire_view view);
+        void update_panel_animations();
+
     public:
         void init(wayfire_output *output);
         ~viewport_manager();
@@ -67,12 +102,16 @@ class viewport_manager : public workspace_manager
         std::tuple<int, int> get_workspace_grid_size();
 
         wayfire_view get_background_view();
+        void load_builtin_background(wayfire_config *config);
+        bool render_background(pixman_region32_t *damage, uint32_t bits);
 
         void add_background(wayfire_view background, int x, int y);
         void add_panel(wayfire_view panel);
         void reserve_workarea(wayfire_shell_panel_position position,
              uint32_t width, uint32_t height);
         void configure_panel(wayfire_view view, int x, int y);
+        void animate_panel(wayfire_view view, int x, int y,
+                uint32_t duration, uint32_t curve);
 
         weston_geometry get_workarea();
 
@@ -133,10 +172,20 @@ void viewport_manager::init(wayfire_output *o)
     o->connect_signal("attach-view", &view_detached);
     o->connect_signal("detach-view", &view_detached);
     o->connect_signal("output-resized", &output_resized);
+
+    panel_animation_hook = [=] () { update_panel_animations(); };
 }
 
 viewport_manager::~viewport_manager()
 {
+    while (!panel_animations.empty())
+        stop_panel_animation(panel_animations.begin()->first);
+
+    if (background_color_tex != (GLuint)-1)
+    {
+        GL_CALL(glDeleteTextures(1, &background_color_tex));
+    }
+
     weston_layer_unset_position(&normal_layer);
     weston_layer_unset_position(&panel_layer);
     weston_layer_unset_position(&background_layer);
@@ -150,6 +199,8 @@ void viewport_manager::view_bring_to_front(wayfire_view view)
 
 void viewport_manager::view_removed(wayfire_view view)
 {
+    stop_panel_animation(view);
+
     if (view->handle->layer_link.layer)
         weston_layer_entry_remove(&view->handle->layer_link);
 
@@ -378,6 +429,85 @@ wayfire_view viewport_manager::get_background_view()
     return background;
 }
 
+void viewport_manager::load_builtin_background(wayfire_config *config)
+{
+    auto section = config->get_section("shell");
+    builtin_background = section->get_string("background_mode", "compositor") == "compositor";
+    if (!builtin_background)
+        return;
+
+    background_color = section->get_color("background_color", {0.1, 0.1, 0.1, 1});
+
+#if BUILD_WITH_IMAGEIO
+    auto path = section->get_string("background", "none");
+    if (path == "none")
+        return;
+
+    /* the texture is shared with the other outputs through the image cache */
+    background_image = image_io::load_from_file_async(path,
+        [=] (image_io::async_texture_ptr)
+        {
+            weston_output_damage(output->handle);
+        });
+#endif
+}
+
+bool viewport_manager::render_background(pixman_region32_t *damage, uint32_t bits)
+{
+    if (!builtin_background || background)
+        return false;
+
+    if (background_color_tex == (GLuint)-1)
+    {
+        uint8_t pixel[] = {
+            uint8_t(background_color.r * 255), uint8_t(background_color.g * 255),
+            uint8_t(background_color.b * 255), uint8_t(background_color.a * 255)
+        };
+
+        GL_CALL(glGenTextures(1, &background_color_tex));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, background_color_tex));
+        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel));
+    }
+
+    GLuint tex = background_color_tex;
+#if BUILD_WITH_IMAGEIO
+    if (background_image && background_image->ready && background_image->tex != (GLuint)-1)
+        tex = background_image->tex;
+#endif
+
+    auto og = output->get_full_geometry();
+
+    pixman_region32_t full;
+    pixman_region32_init_rect(&full, 0, 0, og.width, og.height);
+    if (damage)
+        pixman_region32_intersect(&full, &full, damage);
+
+    auto transform = wayfire_view_transform::global_view_projection *
+        wayfire_view_transform::global_translate *
+        wayfire_view_transform::global_rotation *
+        wayfire_view_transform::global_scale;
+
+    /* the image is stretched over the whole output */
+    int n;
+    auto boxes = pixman_region32_rectangles(&full, &n);
+    for (int i = 0; i < n; i++)
+    {
+        OpenGL::texture_geometry texg = {
+            1.0f * boxes[i].x1 / og.width, 1.0f * boxes[i].y1 / og.height,
+            1.0f * boxes[i].x2 / og.width, 1.0f * boxes[i].y2 / og.height,
+        };
+
+        weston_geometry g = {boxes[i].x1, boxes[i].y1,
+            boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1};
+
+        OpenGL::render_transformed_texture(tex, g, texg, transform, glm::vec4(1),
+                                           bits | TEXTURE_USE_TEX_GEOMETRY);
+    }
+
+    pixman_region32_fini(&full);
+    return true;
+}
+
 void bg_idle_cb(void *data)
 {
     auto output = (weston_output*) data;
@@ -445,9 +575,107 @@ void viewport_manager::reserve_workarea(wayfire_shell_panel_position position,
 }
 
 void viewport_manager::configure_panel(wayfire_view view, int x, int y)
+{
+    stop_panel_animation(view);
+
+    auto g = output->get_full_geometry();
+    view->move(g.x + x, g.y + y);
+}
+
+/* the panel is drawn at its real position plus (1 - progress) * (dx, dy) */
+void viewport_manager::set_panel_offset(wayfire_view view, panel_animation& anim,
+        float progress)
+{
+    float ox = (1 - progress) * anim.dx;
+    float oy = (1 - progress) * anim.dy;
+
+    weston_matrix_init(&anim.transform.matrix);
+    weston_matrix_translate(&anim.transform.matrix, ox, oy, 0);
+    weston_view_geometry_dirty(view->handle);
+    weston_view_schedule_repaint(view->handle);
+
+    /* panels drawn by wayfire itself(with a custom renderer) use the
+     * view transform, in GL coordinates */
+    auto og = output->get_full_geometry();
+    view->transform.translation = glm::translate(glm::mat4(1.0),
+            glm::vec3(2.0f * ox / og.width, -2.0f * oy / og.height, 0));
+}
+
+void viewport_manager::stop_panel_animation(wayfire_view view)
+{
+    auto it = panel_animations.find(view);
+    if (it == panel_animations.end())
+        return;
+
+    wl_list_remove(&it->second.transform.link);
+    weston_view_geometry_dirty(view->handle);
+    weston_view_schedule_repaint(view->handle);
+    view->transform.translation = glm::mat4(1.0);
+    panel_animations.erase(it);
+
+    if (panel_animations.empty() && panel_hook_active)
+    {
+        panel_hook_active = false;
+        output->render->rem_effect(&panel_animation_hook);
+        output->render->auto_redraw(false);
+    }
+}
+
+void viewport_manager::update_panel_animations()
+{
+    std::vector<wayfire_view> finished;
+    for (auto& kv : panel_animations)
+    {
+        auto& anim = kv.second;
+        if (anim.duration.running())
+            set_panel_offset(kv.first, anim, anim.duration.progress());
+        else
+            finished.push_back(kv.first);
+    }
+
+    for (auto view : finished)
+        stop_panel_animation(view);
+}
+
+void viewport_manager::animate_panel(wayfire_view view, int x, int y,
+        uint32_t duration, uint32_t curve)
 {
     auto g = output->get_full_geometry();
+
+    /* start from where the panel is currently visible,
+     * which might be in the middle of another animation */
+    int cx = view->geometry.x, cy = view->geometry.y;
+    auto it = panel_animations.find(view);
+    if (it != panel_animations.end())
+    {
+        cx += it->second.transform.matrix.d[12];
+        cy += it->second.transform.matrix.d[13];
+        stop_panel_animation(view);
+    }
+
     view->move(g.x + x, g.y + y);
+
+    int dx = cx - view->geometry.x, dy = cy - view->geometry.y;
+    if (duration == 0 || (dx == 0 && dy == 0))
+        return;
+
+    auto& anim = panel_animations[view];
+    anim.dx = dx;
+    anim.dy = dy;
+    anim.duration = wf_duration(output, duration,
+            curve == WAYFIRE_SHELL_PANEL_CURVE_EASE_OUT ?
+            wf_animation::ease_out : wf_animation::linear);
+    anim.duration.start();
+
+    wl_list_insert(&view->handle->geometry.transformation_list, &anim.transform.link);
+    set_panel_offset(view, anim, 0);
+
+    if (!panel_hook_active)
+    {
+        panel_hook_active = true;
+        output->render->add_output_effect(&panel_animation_hook);
+        output->render->auto_redraw(true);
+    }
 }
 
 weston_geometry viewport_manager::get_workarea()
@@ -506,6 +734,7 @@ class viewport_impl_plugin : public wayfire_plugin_t {
         vp->init(output);
         vp->draw_panel_over_fullscreen_windows =
             config->get_section("core")->get_int("draw_panel_over_fullscreen_windows", 0);
+        vp->load_builtin_background(config);
 
         output->workspace = vp;
     }
@@ -265,6 +265,8 @@ class wayfire_tile : public wayfire_plugin_t
 
     wayfire_config *config;
 
+    std::unique_ptr<wf_tile_transaction> transaction;
+
     enum
     {
         SELECTOR_ACTION_GO_LEFT           = 0,
@@ -291,6 +293,11 @@ class wayfire_tile : public wayfire_plugin_t
         grab_interface->abilities_mask = WF_ABILITY_CONTROL_WM;
 
         read_config();
+
+        /* how long(in ms) to wait for the clients to resize to the new layout */
+        int timeout = config->get_section("tile")->get_int("transaction_timeout", 150);
+        transaction.reset(new wf_tile_transaction(output, grab_interface, timeout));
+
         init_roots();
         setup_event_handlers();
 
@@ -636,9 +643,10 @@ class wayfire_tile : public wayfire_plugin_t
     void stop_select_mode()
     {
         output->render->auto_redraw(0);
-        output->render->reset_renderer();
         output->render->rem_effect(&draw_selected);
 
+        output->render->reset_renderer();
+
         output->deactivate_plugin(grab_interface);
         grab_interface->ungrab();
     }
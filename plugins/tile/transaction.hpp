@@ -0,0 +1,282 @@
+#ifndef TILE_TRANSACTION_HPP
+#define TILE_TRANSACTION_HPP
+
+#include <map>
+#include <view.hpp>
+#include <output.hpp>
+#include <core.hpp>
+#include <opengl.hpp>
+#include <render-manager.hpp>
+#include <signal-definitions.hpp>
+#include <debug.hpp>
+#include <libweston-desktop.h>
+
+/* A change of the layout(split, resize, new or removed view...) gives new
+ * boxes to many views at once. Configuring each view while the tree is
+ * walked shows the intermediate layouts and overlapping tiles, so instead:
+ *
+ * 1. the new geometries are collected until the event loop is idle
+ * 2. the new sizes are sent to all clients together, and until they answer,
+ *    each view stays in its old box, its buffer is scaled to fit it
+ * 3. when every client has committed a buffer with a new size(or after
+ *    a timeout), all views are moved to their boxes in the same frame
+ *
+ * The views are only transformed, so they are drawn in their place in the
+ * stack by whichever renderer is in use. If another plugin is active on
+ * the output, the geometries are applied right away.
+ *
+ * Layout changes made while a transaction is in progress go to the next one */
+class wf_tile_transaction
+{
+    struct entry
+    {
+        wayfire_view view;
+        weston_geometry old, target;
+        bool ready = false;
+
+        /* maps the committed buffer to the old box */
+        weston_transform transform;
+        bool has_transform = false;
+    };
+
+    wayfire_output *output;
+    wayfire_grab_interface owner;
+    int timeout_ms;
+
+    /* the geometries for the next transaction, the latest one for each view */
+    std::map<wayfire_view, weston_geometry> next;
+    /* std::map, because the transforms are linked in weston's lists */
+    std::map<wayfire_view, entry> pending;
+    bool in_progress = false;
+
+    wl_event_source *idle_start = NULL, *timeout = NULL;
+    signal_callback_t size_committed, view_removed;
+
+    static std::map<wayfire_output*, wf_tile_transaction*>& instances()
+    {
+        static std::map<wayfire_output*, wf_tile_transaction*> map;
+        return map;
+    }
+
+    static void idle_start_cb(void *data)
+    {
+        auto transaction = (wf_tile_transaction*) data;
+        transaction->idle_start = NULL;
+        transaction->start();
+    }
+
+    static int timeout_cb(void *data)
+    {
+        auto transaction = (wf_tile_transaction*) data;
+        debug << "tile: transaction timed out, applying it anyway" << std::endl;
+        transaction->apply();
+        return 0;
+    }
+
+    void schedule_start()
+    {
+        if (in_progress || idle_start)
+            return;
+
+        auto loop = wl_display_get_event_loop(core->ec->wl_display);
+        idle_start = wl_event_loop_add_idle(loop, idle_start_cb, this);
+    }
+
+    /* scale the committed contents of the view to its old box */
+    void update_transform(entry& e)
+    {
+        auto committed = weston_desktop_surface_get_geometry(e.view->desktop_surface);
+        if (committed.width <= 0 || committed.height <= 0)
+            return;
+
+        float sx = 1.0 * e.old.width / committed.width;
+        float sy = 1.0 * e.old.height / committed.height;
+
+        if (!e.has_transform)
+        {
+            wl_list_insert(&e.view->handle->geometry.transformation_list,
+                    &e.transform.link);
+            e.has_transform = true;
+        }
+
+        /* in surface-local coordinates, around the top-left corner of the window */
+        weston_matrix_init(&e.transform.matrix);
+        weston_matrix_translate(&e.transform.matrix, -committed.x, -committed.y, 0);
+        weston_matrix_scale(&e.transform.matrix, sx, sy, 1);
+        weston_matrix_translate(&e.transform.matrix, committed.x, committed.y, 0);
+        weston_view_geometry_dirty(e.view->handle);
+        weston_view_schedule_repaint(e.view->handle);
+
+        /* views drawn by wayfire itself(with a custom renderer) use the
+         * view transform, in GL coordinates */
+        auto og = output->get_full_geometry();
+        glm::vec2 corner = {2.0f * (e.old.x - og.x) / og.width - 1,
+            1 - 2.0f * (e.old.y - og.y) / og.height};
+
+        e.view->transform.scale = glm::scale(glm::mat4(1.0), {sx, sy, 1});
+        e.view->transform.translation = glm::translate(glm::mat4(1.0),
+                {corner.x * (1 - sx), corner.y * (1 - sy), 0});
+    }
+
+    void remove_transform(entry& e)
+    {
+        if (!e.has_transform)
+            return;
+
+        wl_list_remove(&e.transform.link);
+        weston_view_geometry_dirty(e.view->handle);
+        weston_view_schedule_repaint(e.view->handle);
+
+        e.view->transform.scale = e.view->transform.translation = glm::mat4(1.0);
+        e.has_transform = false;
+    }
+
+    void start()
+    {
+        if (in_progress || next.empty())
+            return;
+
+        /* the other plugin may be drawing or moving the views itself */
+        bool direct = output->is_other_plugin_active(owner);
+
+        for (auto& g : next)
+        {
+            auto view = g.first;
+            if (view->destroyed || view->output != output || view->geometry == g.second)
+                continue;
+
+            if (direct)
+            {
+                view->set_geometry(g.second);
+                continue;
+            }
+
+            auto& e = pending[view];
+            e.view = view;
+            e.old = view->geometry;
+            e.target = g.second;
+            /* views which only move don't have to wait for the client */
+            e.ready = e.old.width == e.target.width && e.old.height == e.target.height;
+        }
+        next.clear();
+
+        in_progress = true;
+        if (check_ready())
+            return;
+
+        for (auto& p : pending)
+        {
+            auto& e = p.second;
+            if (e.ready)
+                continue;
+
+            update_transform(e);
+            e.view->resize(e.target.width, e.target.height);
+        }
+
+        auto loop = wl_display_get_event_loop(core->ec->wl_display);
+        timeout = wl_event_loop_add_timer(loop, timeout_cb, this);
+        wl_event_source_timer_update(timeout, timeout_ms);
+    }
+
+    /* applies the transaction if all clients have answered */
+    bool check_ready()
+    {
+        for (auto& p : pending)
+        {
+            if (!p.second.ready)
+                return false;
+        }
+
+        apply();
+        return true;
+    }
+
+    void apply()
+    {
+        if (!in_progress)
+            return;
+
+        for (auto& p : pending)
+        {
+            /* the client may have chosen a different size,
+             * that's fine, we only place it in its box */
+            remove_transform(p.second);
+            p.second.view->move(p.second.target.x, p.second.target.y);
+        }
+
+        if (timeout)
+            wl_event_source_remove(timeout);
+        timeout = NULL;
+
+        pending.clear();
+        in_progress = false;
+
+        if (!next.empty())
+            schedule_start();
+    }
+
+    public:
+    wf_tile_transaction(wayfire_output *output, wayfire_grab_interface owner,
+            int timeout_ms) : output(output), owner(owner), timeout_ms(timeout_ms)
+    {
+        instances()[output] = this;
+
+        size_committed = [=] (signal_data *data)
+        {
+            auto conv = static_cast<view_geometry_changed_signal*> (data);
+            auto it = pending.find(conv->view);
+            if (it == pending.end() || it->second.ready)
+                return;
+
+            it->second.ready = true;
+            update_transform(it->second);
+            check_ready();
+        };
+        output->connect_signal("view-size-committed", &size_committed);
+
+        view_removed = [=] (signal_data *data)
+        {
+            auto view = static_cast<destroy_view_signal*> (data)->destroyed_view;
+            next.erase(view);
+
+            auto it = pending.find(view);
+            if (it != pending.end())
+            {
+                remove_transform(it->second);
+                pending.erase(it);
+            }
+
+            if (in_progress)
+                check_ready();
+        };
+        output->connect_signal("detach-view", &view_removed);
+    }
+
+    ~wf_tile_transaction()
+    {
+        apply();
+
+        if (idle_start)
+            wl_event_source_remove(idle_start);
+
+        output->disconnect_signal("view-size-committed", &size_committed);
+        output->disconnect_signal("detach-view", &view_removed);
+        instances().erase(output);
+    }
+
+    static wf_tile_transaction* get(wayfire_output *output)
+    {
+        auto it = instances().find(output);
+        return it == instances().end() ? nullptr : it->second;
+    }
+
+    /* g is in output-local coordinates */
+    void set_geometry(wayfire_view view, weston_geometry g)
+    {
+        next[view] = g;
+        schedule_start();
+    }
+};
+
+#endif /* end of include guard: TILE_TRANSACTION_HPP */
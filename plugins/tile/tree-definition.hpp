@@ -7,6 +7,7 @@
 #include <output.hpp>
 #include <workspace-manager.hpp>
 #include <debug.hpp>
+#include "transaction.hpp"
 
 #define tile_data "__tile_data"
 
@@ -32,7 +33,13 @@ void view_fit_to_box(wayfire_view view, weston_geometry box)
 
     box.x -= sw * vx;
     box.y -= sh * vy;
-    view->set_geometry(box);
+
+    /* applied together with the rest of the layout change */
+    auto transaction = wf_tile_transaction::get(view->output);
+    if (transaction)
+        transaction->set_geometry(view, box);
+    else
+        view->set_geometry(box);
 }
 
 struct wf_tree_node
@@ -1,5 +1,6 @@
 #include "config.hpp"
 #include <cstdlib>
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 #include <libevdev/libevdev.h>
@@ -28,8 +29,7 @@ int wayfire_config_section::get_int(string name, int df)
 
 int wayfire_config_section::get_duration(string name, int df)
 {
-    int result = get_int(name, df * (1000 / refresh_rate));
-    return result / (1000 / refresh_rate);
+    return std::max(0, get_int(name, df));
 }
 
 double wayfire_config_section::get_double(string name, double df)
@@ -185,7 +185,7 @@ static lines_t merge_lines(const lines_t& file)
     return merged;
 }
 
-wayfire_config::wayfire_config(string name, int rr)
+wayfire_config::wayfire_config(string name)
 {
     std::ifstream file(name);
     string line;
@@ -195,7 +195,6 @@ wayfire_config::wayfire_config(string name, int rr)
     out << "use config: " << name << std::endl;
 #endif
 
-    refresh_rate = rr;
     wayfire_config_section *current_section;
 
     lines_t lines;
@@ -213,7 +212,6 @@ wayfire_config::wayfire_config(string name, int rr)
         if (line[0] == '[')
         {
             current_section = new wayfire_config_section();
-            current_section->refresh_rate = rr;
             current_section->name = line.substr(1, line.size() - 2);
             sections.push_back(current_section);
             continue;
@@ -242,13 +240,6 @@ wayfire_config_section* wayfire_config::get_section(string name)
 
     auto nsect = new wayfire_config_section();
     nsect->name = name;
-    nsect->refresh_rate = refresh_rate;
     sections.push_back(nsect);
     return nsect;
 }
-
-void wayfire_config::set_refresh_rate(int rr)
-{
-    for (auto section : sections)
-        section->refresh_rate = rr;
-}
@@ -21,13 +21,11 @@ struct wayfire_color {
 
 struct wayfire_config_section {
     std::string name;
-    int refresh_rate;
     std::map<std::string, std::string> options;
 
     std::string get_string(std::string name, std::string default_value);
     int get_int(std::string name, int default_value);
-    /* reads the specified option which is interpreted as duration in milliseconds
-     * returns the number of frames this duration is equivalent to */
+    /* reads the specified option which is interpreted as duration in milliseconds */
     int get_duration(std::string name, int default_value);
     double get_double(std::string name, double default_value);
 
@@ -41,12 +39,10 @@ struct wayfire_config_section {
 
 class wayfire_config {
     std::vector<wayfire_config_section*> sections;
-    int refresh_rate;
 
     public:
-    wayfire_config(std::string file, int refresh_rate = -1);
+    wayfire_config(std::string file);
     wayfire_config_section* get_section(std::string name);
-    void set_refresh_rate(int refresh_rate);
 };
 
 #endif /* end of include guard: CONFIG_HPP */
@@ -121,3 +121,14 @@ void damage_commit_window(wayfire_window *w)
     auto window = static_cast<egl_window*> (w);
     cairo_gl_surface_swapbuffers(window->cairo_surface);
 }
+
+/* the back buffer is undefined after swapping, so we always present everything */
+void damage_commit_window(wayfire_window *w, cairo_region_t *damage)
+{
+    damage_commit_window(w);
+}
+
+bool backend_preserves_contents()
+{
+    return false;
+}
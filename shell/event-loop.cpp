@@ -0,0 +1,329 @@
+#include "event-loop.hpp"
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <glib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+using loop_clock = std::chrono::steady_clock;
+
+struct loop_timer
+{
+    loop_clock::time_point deadline;
+    loop_callback callback;
+};
+
+static struct
+{
+    wl_display *display = nullptr;
+    int epoll_fd = -1, timer_fd = -1, post_fd = -1;
+    bool running = false;
+
+    /* shared_ptr so that a callback can remove its own fd */
+    std::map<int, std::shared_ptr<loop_fd_callback>> fds;
+
+    int last_timer_id = 0;
+    std::map<int, loop_timer> timers;
+
+    std::mutex post_mutex;
+    std::vector<loop_callback> posted;
+
+    /* the D-Bus proxies of the widget backends use the default GMainContext,
+     * its fds are polled together with the epoll fd */
+    GMainContext *glib_context = nullptr;
+    std::vector<GPollFD> glib_fds;
+    gint glib_max_priority;
+    int glib_n_fds = 0;
+} loop;
+
+static bool epoll_add(int fd, uint32_t events)
+{
+    epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        std::cerr << "loop: failed to add fd " << fd << " to epoll" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/* arm the timerfd for the earliest deadline */
+static void update_timer_fd()
+{
+    itimerspec spec = {{0, 0}, {0, 0}};
+
+    if (!loop.timers.empty())
+    {
+        auto earliest = loop.timers.begin()->second.deadline;
+        for (auto& t : loop.timers)
+            earliest = std::min(earliest, t.second.deadline);
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+            (earliest - loop_clock::now()).count();
+
+        /* a zero value would disarm the timer */
+        ns = std::max(ns, (decltype(ns)) 1);
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+
+    timerfd_settime(loop.timer_fd, 0, &spec, NULL);
+}
+
+static void dispatch_timers()
+{
+    uint64_t expirations;
+    if (read(loop.timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return;
+
+    auto now = loop_clock::now();
+
+    std::vector<int> expired;
+    for (auto& t : loop.timers)
+    {
+        if (t.second.deadline <= now)
+            expired.push_back(t.first);
+    }
+
+    for (auto id : expired)
+    {
+        /* an earlier callback might have removed it */
+        auto it = loop.timers.find(id);
+        if (it == loop.timers.end())
+            continue;
+
+        auto callback = std::move(it->second.callback);
+        loop.timers.erase(it);
+        callback();
+    }
+
+    update_timer_fd();
+}
+
+static void dispatch_posted()
+{
+    uint64_t count;
+    if (read(loop.post_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        return;
+
+    std::vector<loop_callback> callbacks;
+    loop.post_mutex.lock();
+    std::swap(callbacks, loop.posted);
+    loop.post_mutex.unlock();
+
+    for (auto& cb : callbacks)
+        cb();
+}
+
+bool loop_init(wl_display *display)
+{
+    loop.display = display;
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    loop.post_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (loop.epoll_fd < 0 || loop.timer_fd < 0 || loop.post_fd < 0)
+    {
+        std::cerr << "loop: failed to create the event loop fds" << std::endl;
+        return false;
+    }
+
+    loop.glib_context = g_main_context_default();
+    if (!g_main_context_acquire(loop.glib_context))
+    {
+        std::cerr << "loop: failed to acquire the GLib main context" << std::endl;
+        return false;
+    }
+
+    return epoll_add(wl_display_get_fd(display), EPOLLIN) &&
+        epoll_add(loop.timer_fd, EPOLLIN) && epoll_add(loop.post_fd, EPOLLIN);
+}
+
+void loop_fini()
+{
+    loop.fds.clear();
+    loop.timers.clear();
+    g_main_context_release(loop.glib_context);
+
+    close(loop.post_fd);
+    close(loop.timer_fd);
+    close(loop.epoll_fd);
+}
+
+void loop_quit()
+{
+    loop.running = false;
+}
+
+/* wait for the epoll fd and the GLib sources at the same time.
+ * The GLib sources are dispatched by dispatch_glib() afterwards */
+static int wait_events(epoll_event *events, int max_events)
+{
+    gint timeout;
+    g_main_context_prepare(loop.glib_context, &loop.glib_max_priority);
+
+    int n_glib;
+    while ((n_glib = g_main_context_query(loop.glib_context, loop.glib_max_priority, &timeout,
+                loop.glib_fds.data(), loop.glib_fds.size())) > (int)loop.glib_fds.size())
+    {
+        loop.glib_fds.resize(n_glib);
+    }
+
+    std::vector<pollfd> fds(n_glib + 1);
+    fds[0] = {loop.epoll_fd, POLLIN, 0};
+    for (int i = 0; i < n_glib; i++)
+        fds[i + 1] = {loop.glib_fds[i].fd, (short)loop.glib_fds[i].events, 0};
+
+    loop.glib_n_fds = n_glib;
+    int r = poll(fds.data(), fds.size(), timeout);
+    if (r < 0)
+    {
+        loop.glib_n_fds = 0;
+        return r;
+    }
+
+    for (int i = 0; i < n_glib; i++)
+        loop.glib_fds[i].revents = fds[i + 1].revents;
+
+    if (!(fds[0].revents & POLLIN))
+        return 0;
+
+    return epoll_wait(loop.epoll_fd, events, max_events, 0);
+}
+
+static void dispatch_glib()
+{
+    if (g_main_context_check(loop.glib_context, loop.glib_max_priority,
+            loop.glib_fds.data(), loop.glib_n_fds))
+    {
+        g_main_context_dispatch(loop.glib_context);
+    }
+}
+
+void loop_run()
+{
+    const int max_events = 16;
+    epoll_event events[max_events];
+
+    int wl_fd = wl_display_get_fd(loop.display);
+
+    loop.running = true;
+    while (loop.running)
+    {
+        while (wl_display_prepare_read(loop.display) != 0)
+            wl_display_dispatch_pending(loop.display);
+
+        if (wl_display_flush(loop.display) < 0 && errno != EAGAIN)
+        {
+            wl_display_cancel_read(loop.display);
+            break;
+        }
+
+        int n = wait_events(events, max_events);
+        if (n < 0)
+        {
+            int err = errno;
+            wl_display_cancel_read(loop.display);
+            dispatch_glib();
+            if (err == EINTR)
+                continue;
+            break;
+        }
+
+        bool wl_ready = false;
+        for (int i = 0; i < n; i++)
+            wl_ready |= events[i].data.fd == wl_fd;
+
+        if (wl_ready)
+        {
+            if (wl_display_read_events(loop.display) < 0)
+                break;
+        } else
+        {
+            wl_display_cancel_read(loop.display);
+        }
+
+        if (wl_display_dispatch_pending(loop.display) < 0)
+            break;
+
+        dispatch_glib();
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == wl_fd)
+                continue;
+
+            if (fd == loop.timer_fd)
+            {
+                dispatch_timers();
+            } else if (fd == loop.post_fd)
+            {
+                dispatch_posted();
+            } else
+            {
+                auto it = loop.fds.find(fd);
+                if (it == loop.fds.end())
+                    continue;
+
+                auto callback = it->second;
+                (*callback)(events[i].events);
+            }
+        }
+    }
+
+    loop.running = false;
+}
+
+void loop_add_fd(int fd, uint32_t events, loop_fd_callback callback)
+{
+    if (epoll_add(fd, events))
+        loop.fds[fd] = std::make_shared<loop_fd_callback> (callback);
+}
+
+void loop_remove_fd(int fd)
+{
+    if (loop.fds.erase(fd))
+        epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int loop_add_timer(int timeout_ms, loop_callback callback)
+{
+    int id = ++loop.last_timer_id;
+
+    auto& timer = loop.timers[id];
+    timer.deadline = loop_clock::now() + std::chrono::milliseconds(timeout_ms);
+    timer.callback = callback;
+
+    update_timer_fd();
+    return id;
+}
+
+void loop_remove_timer(int id)
+{
+    if (loop.timers.erase(id))
+        update_timer_fd();
+}
+
+void loop_post(loop_callback callback)
+{
+    loop.post_mutex.lock();
+    loop.posted.push_back(callback);
+    loop.post_mutex.unlock();
+
+    uint64_t one = 1;
+    if (write(loop.post_fd, &one, sizeof(one)) < 0)
+        std::cerr << "loop: failed to wake up the main thread" << std::endl;
+}
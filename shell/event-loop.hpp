@@ -0,0 +1,35 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <functional>
+#include <wayland-client.h>
+
+/* The main loop of the shell client. Instead of blocking in wl_display_dispatch()
+ * and polling for changes, everything which can wake the client up(the wayland
+ * connection, timers, other file descriptors and functions posted from other
+ * threads) is waited on with a single epoll fd. Sources attached to the default
+ * GMainContext(for ex. D-Bus signals) are dispatched from the same loop */
+
+using loop_callback = std::function<void()>;
+using loop_fd_callback = std::function<void(uint32_t events)>;
+
+bool loop_init(wl_display *display);
+void loop_fini();
+
+/* runs until the wayland connection is broken or loop_quit() is called */
+void loop_run();
+void loop_quit();
+
+/* callback is called with the epoll events whenever fd becomes ready */
+void loop_add_fd(int fd, uint32_t events, loop_fd_callback callback);
+void loop_remove_fd(int fd);
+
+/* one-shot timers, the returned id can be used to cancel them.
+ * A timeout of 0 means "as soon as the current events are dispatched" */
+int  loop_add_timer(int timeout_ms, loop_callback callback);
+void loop_remove_timer(int id);
+
+/* can be called from any thread, callback is then run in the main thread */
+void loop_post(loop_callback callback);
+
+#endif /* end of include guard: EVENT_LOOP_HPP */
@@ -2,9 +2,11 @@
 #include "window.hpp"
 #include "../proto/wayfire-shell-client.h"
 #include "../shared/config.hpp"
+#include "event-loop.hpp"
 #include <assert.h>
-#include <functional>
-#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
 
 const double adjustment[][3] = {
     {1.00000000, 0.71976951, 0.42860152}, /* 3000K */
@@ -64,53 +66,39 @@ void gamma_adjust::set_gamma(int temp)
             &gamma_value[1], &gamma_value[2]);
 }
 
-void gamma_adjust::continuous_change(int from, int to)
+int gamma_adjust::get_target_temperature()
 {
-    if (from != to) {
-        int dx = 50 * (to - from) / std::abs(from - to);
-        for (int i = from; i * dx < to * dx; i += dx) {
-            set_gamma(i);
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        }
-    }
+    using std::chrono::system_clock;
 
-    set_gamma(to);
+    auto tmp = system_clock::to_time_t(system_clock::now());
+    auto tm2 = std::localtime(&tmp);
+
+    int current = tm2->tm_hour * 60 + tm2->tm_min;
+    if (current >= day_start && current <= day_end)
+        return daytime_temp;
+    else
+        return nighttime_temp;
 }
 
-#define clock std::chrono::system_clock
-using pii = std::pair<int, int>;
-void gamma_adjust::adjustment_loop()
+/* when the target temperature changes, we move towards it by 50K every 500ms.
+ * Otherwise, the gamma is refreshed once a minute */
+void gamma_adjust::adjustment_step()
 {
-    /* we rely on the OS to clean up our thread */
-    int iter = 0;
-    while(true) {
-        auto tmp = clock::to_time_t(clock::now());
-        auto tm2 = std::localtime(&tmp);
-
-        int current = tm2->tm_hour * 60 + tm2->tm_min;
-
-        int target;
-
-        if (current >= day_start && current <= day_end) {
-            target = daytime_temp;
-        } else {
-            target = nighttime_temp;
-        }
-
-        if (current_temp != target || iter == 0) {
-            continuous_change(current_temp, target);
-            current_temp = target;
-        } else
-        {
-            continuous_change(target, target);
-        }
-        ++iter;
-
-        /* should probably use sleep_until, altough this works just as fine */
-        std::this_thread::sleep_for(std::chrono::minutes(1));
+    timer = -1;
+
+    int target = get_target_temperature();
+    if (std::abs(target - current_temp) <= 50)
+    {
+        current_temp = target;
+        set_gamma(current_temp);
+        timer = loop_add_timer(60 * 1000, [=] () { adjustment_step(); });
+        return;
     }
+
+    current_temp += target > current_temp ? 50 : -50;
+    set_gamma(current_temp);
+    timer = loop_add_timer(500, [=] () { adjustment_step(); });
 }
-#undef clock
 
 gamma_adjust::gamma_adjust(uint32_t out, uint32_t sz, wayfire_config *config)
     : output(out), gamma_size(sz)
@@ -134,10 +122,12 @@ gamma_adjust::gamma_adjust(uint32_t out, uint32_t sz, wayfire_config *config)
         wl_array_add(&gamma_value[i], gamma_size * sizeof(uint16_t));
     }
 
-    auto fn = std::bind(std::mem_fn(&gamma_adjust::adjustment_loop), this);
-    auto th = std::thread(fn);
+    adjustment_step();
+}
 
-    /* the adjustment loop is what actually changes color temperature,
-     * we separate it from the main thread as it sleeps while inactive */
-    th.detach();
+gamma_adjust::~gamma_adjust()
+{
+    loop_remove_timer(timer);
+    for (int i = 0; i < 3; i++)
+        wl_array_release(&gamma_value[i]);
 }
@@ -18,12 +18,14 @@ class gamma_adjust {
 
     int current_temp = 6500;
     void set_gamma(int temp);
-    void continuous_change(int from, int to);
 
-    void adjustment_loop();
+    int timer = -1;
+    int get_target_temperature();
+    void adjustment_step();
 
     public:
     gamma_adjust(uint32_t _output, uint32_t _gamma_size, wayfire_config *config);
+    ~gamma_adjust();
 };
 
 
@@ -1,6 +1,7 @@
 #include "panel.hpp"
 #include "background.hpp"
 #include "gamma.hpp"
+#include "event-loop.hpp"
 #include "../shared/config.hpp"
 #include <vector>
 #include <map>
@@ -17,12 +18,18 @@ wayfire_config *config;
 std::map<uint32_t, wayfire_shell_output> outputs;
 
 std::string bg_path;
+/* the compositor draws the wallpaper itself unless background_mode = client */
+bool client_background = false;
 
 void output_created_cb(void *data, wayfire_shell *wayfire_shell,
         uint32_t output, uint32_t width, uint32_t height)
 {
-    auto bg = (outputs[output].background = new wayfire_background(bg_path));
-    bg->create_background(output, width, height);
+    outputs[output].background = nullptr;
+    if (client_background)
+    {
+        auto bg = (outputs[output].background = new wayfire_background(bg_path));
+        bg->create_background(output, width, height);
+    }
 
     auto panel = (outputs[output].panel = new wayfire_panel(config));
     panel->create_panel(output, width, height);
@@ -93,17 +100,18 @@ int main()
     auto section = config->get_section("shell");
 
     bg_path = section->get_string("background", "none");
+    client_background =
+        section->get_string("background_mode", "compositor") == "client";
 
     gamma_adjust_enabled = section->get_int("color_temp_enabled", 0);
     if (!setup_wayland_connection())
         return -1;
 
-    wayfire_shell_add_listener(display.wfshell, &bg_shell_listener, 0);
+    if (!loop_init(display.wl_disp))
+        return -1;
 
-    while(true) {
-        if (wl_display_dispatch(display.wl_disp) < 0)
-            break;
-    }
+    wayfire_shell_add_listener(display.wfshell, &bg_shell_listener, 0);
+    loop_run();
 
     for (auto x : outputs) {
         if (x.second.panel)
@@ -114,5 +122,6 @@ int main()
             delete x.second.gamma;
     }
 
+    loop_fini();
     finish_wayland_connection();
 }
@@ -1,15 +1,13 @@
 #include "net.hpp"
+#include "text-cache.hpp"
 #include <gio/gio.h>
-#include <glib-unix.h>
 #include <iostream>
-#include <signal.h>
 
 struct network_provider_backend
 {
-    /* setup backend AND initially populate the connection info, then set updated = true */
+    /* setup backend AND initially populate the connection info. Changes are
+     * reported with connection_info::notify() from the shell's main loop */
     virtual bool create(connection_info *store) = 0;
-    /* called by the thread starter, see network_widget source code */
-    virtual void thread_loop() = 0;
 
     virtual ~network_provider_backend() = 0;
 };
@@ -35,16 +33,11 @@ on_wifi_properties_changed (GDBusProxy          *proxy,
         while (g_variant_iter_loop(iter, "{&sv}", &key, &value))
         {
             if (std::string(key) == "Strength")
-            {
-                info->mutex.lock();
                 info->strength = g_variant_get_byte(value);
-                for (auto& p : info->updated)
-                    p.second = true;
-                info->mutex.unlock();
-            }
         }
 
         g_variant_iter_free(iter);
+        info->notify();
     }
 }
 
@@ -74,12 +67,6 @@ on_nm_properties_changed (GDBusProxy          *proxy,
     }
 }
 
-static gboolean handle_exit_signal(gpointer data)
-{
-    g_main_loop_quit((GMainLoop*) data);
-    return G_SOURCE_REMOVE;
-}
-
 struct network_manager_provider : public network_provider_backend
 {
     connection_info *info;
@@ -129,14 +116,7 @@ struct network_manager_provider : public network_provider_backend
         }
 
         GVariant *gv = g_dbus_proxy_get_cached_property(current_specific_proxy, "Strength");
-
-        info->mutex.lock();
         info->strength = g_variant_get_byte(gv);
-
-        for (auto& p : info->updated)
-            p.second = true;
-        info->mutex.unlock();
-
         g_variant_unref(gv);
 
         g_signal_connect(current_specific_proxy, "g-properties-changed",
@@ -145,21 +125,14 @@ struct network_manager_provider : public network_provider_backend
 
     void load_bluetooth_data(const gchar *dev)
     {
-        info->mutex.lock();
         /* TODO: implement */
     }
 
     void load_ethernet_data(const gchar *dev)
     {
-        info->mutex.lock();
-
         info->icon = "none";
         info->strength = 100;
         info->name = "Ethernet";
-
-        for (auto& p : info->updated)
-            p.second = true;
-        info->mutex.unlock();
     }
 
     void active_connection_updated()
@@ -179,13 +152,8 @@ struct network_manager_provider : public network_provider_backend
         /* no active connection */
         if (std::string(active_connection) == "/")
         {
-            info->mutex.lock();
             info->name = "No network";
-            for (auto& p : info->updated)
-                p.second = true;
             info->strength = 0;
-            info->mutex.unlock();
-
             return;
         }
 
@@ -210,9 +178,7 @@ struct network_manager_provider : public network_provider_backend
         g_variant_unref(gv);
         gv = g_dbus_proxy_get_cached_property(aconn_proxy, "Id");
 
-        info->mutex.lock();
         info->name = g_variant_get_string(gv, &n);
-        info->mutex.unlock();
 
         g_variant_unref(gv);
         gv = g_dbus_proxy_get_cached_property(aconn_proxy, "SpecificObject");
@@ -238,15 +204,13 @@ struct network_manager_provider : public network_provider_backend
 
     void load_initial_connection_info()
     {
-        /* don't have to lock mutex, as we are still in the main thread */
-        for (auto& p : info->updated)
-            p.second = true;
         info->icon = info->name = "none";
         info->strength = 0;
 
         active_connection_updated();
     }
 
+    updater_callback callback;
     bool create(connection_info *info)
     {
         this->info = info;
@@ -255,32 +219,25 @@ struct network_manager_provider : public network_provider_backend
             return false;
 
         load_initial_connection_info();
-        return true;
-    }
 
-    void thread_loop()
-    {
-        updater_callback callback =
-            std::bind(std::mem_fn(&network_manager_provider::active_connection_updated), this);
+        /* the signals are dispatched by the shell's main loop */
+        callback = [=] ()
+        {
+            active_connection_updated();
+            this->info->notify();
+        };
 
         g_signal_connect(nm_proxy, "g-properties-changed",
                          G_CALLBACK(on_nm_properties_changed), &callback);
-
-        GMainLoop *loop = g_main_loop_new(NULL, false);
-        g_unix_signal_add(SIGUSR1, handle_exit_signal, loop);
-
-        g_main_loop_run(loop);
-
-        g_main_loop_unref(loop);
-        g_object_unref(nm_proxy);
+        return true;
     }
 
     ~network_manager_provider()
     {
+        g_object_unref(nm_proxy);
     }
 };
 
-std::thread network_widget::updater_thread;
 connection_info *network_widget::connection;
 network_provider_backend *network_widget::backend = nullptr;
 
@@ -298,14 +255,9 @@ void network_widget::create()
             backend = nullptr;
             return;
         }
-
-        updater_thread = std::thread([=] () { backend->thread_loop(); });
     }
 
-    connection->mutex.lock();
-    id = (connection->updated.empty() ? 0 : (--connection->updated.end())->first) + 1;
-    connection->updated[id] = true;
-    connection->mutex.unlock();
+    id = connection->subscribe(need_update);
 
     load_default_font();
     width = 20 * font_size;
@@ -313,9 +265,10 @@ void network_widget::create()
 
 network_widget::~network_widget()
 {
-    connection->mutex.lock();
-    connection->updated.erase(id);
-    connection->mutex.unlock();
+    if (!backend)
+        return;
+
+    connection->unsubscribe(id);
 }
 
 bool network_widget::update(bool reset)
@@ -323,26 +276,11 @@ bool network_widget::update(bool reset)
     if (!backend)
         return false;
 
-    bool result;
-    std::string text;
-    connection->mutex.lock();
-    result = connection->updated[id];
-    text = connection->name;
-    connection->mutex.unlock();
-
-    if (result || reset)
-    {
-
-        cairo_set_font_size(cr, font_size);
-        cairo_set_font_face(cr, cairo_font_face);
-
-        cairo_text_extents_t te;
-        cairo_text_extents(cr, text.c_str(), &te);
+    /* we are asked to update only after the connection has changed */
+    auto te = text_cache_extents(cairo_font_face, font_size, connection->name);
+    width = te.width + font_size;
 
-        width = te.width + font_size;
-    }
-
-    return result;
+    return true;
 }
 
 inline wayfire_color interpolate_color(wayfire_color start, wayfire_color end, float a)
@@ -370,8 +308,6 @@ void network_widget::repaint()
     std::string text;
     wayfire_color color;
 
-    connection->mutex.lock();
-
 #define STRENGTH_GOOD 40
 #define STRENGTH_AVG 25
 
@@ -385,11 +321,7 @@ void network_widget::repaint()
     else
         color = color_bad;
 
-    connection->updated[id] = false;
-    connection->mutex.unlock();
-
     cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
 
-    cairo_move_to(cr, x + font_size * 0.5, font_size);
-    cairo_show_text(cr, text.c_str());
+    text_cache_show(cr, cairo_font_face, font_size, x + font_size * 0.5, font_size, text);
 }
@@ -2,17 +2,12 @@
 #define NET_HPP
 
 #include "widgets.hpp"
-#include <thread>
-#include <mutex>
 
-struct connection_info
+struct connection_info : public widget_model
 {
     std::string name;
     int strength; /* in percentage, for Wi-Fi/Broadband */
     std::string icon;
-
-    std::map<int, bool> updated;
-    std::mutex mutex;
 };
 
 struct network_provider_backend;
@@ -20,7 +15,6 @@ struct network_provider_backend;
 struct network_widget : public widget
 {
     private:
-    static std::thread updater_thread;
     static connection_info *connection;
     static network_provider_backend *backend;
 
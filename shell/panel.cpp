@@ -1,10 +1,12 @@
 #include <sstream>
-#include <unistd.h>
-#include <sys/time.h>
+#include <cstdlib>
+#include <algorithm>
 #include <linux/input-event-codes.h>
 #include "panel.hpp"
 #include "widgets.hpp"
 #include "net.hpp"
+#include "event-loop.hpp"
+#include "text-cache.hpp"
 #include "../proto/wayfire-shell-client.h"
 #include "../shared/config.hpp"
 
@@ -59,6 +61,12 @@ void wayfire_panel::set_autohide(bool ah)
 
 wayfire_panel::~wayfire_panel()
 {
+    loop_remove_timer(wait_timer);
+    loop_remove_timer(repaint_timer);
+    loop_remove_timer(animation_timer);
+    if (repaint_callback)
+        wl_callback_destroy(repaint_callback);
+
 //    cairo_destroy(cr);
     for_each_widget(w)
     {
@@ -80,7 +88,9 @@ void wayfire_panel::create_panel(uint32_t output, uint32_t _width, uint32_t _hei
 
     setup_window();
     init_widgets();
-    render_frame(true);
+
+    need_fullredraw = true;
+    repaint();
 }
 
 int last_x, last_y;
@@ -91,8 +101,6 @@ void wayfire_panel::setup_window()
 
     cr = cairo_create(window->cairo_surface);
 
-    repaint_callback = nullptr;
-
     using namespace std::placeholders;
     window->pointer_enter = [=] (wl_pointer*, uint32_t time, int, int)
                                 { show(200);
@@ -153,6 +161,11 @@ void wayfire_panel::setup_window()
 
     wayfire_shell_configure_panel(display.wfshell, output, window->surface, 0, -height);
 
+    loop_remove_timer(wait_timer);
+    wait_timer = -1;
+    loop_remove_timer(animation_timer);
+    animation_timer = -1;
+
     state = HIDDEN;
     animation.y = -height;
     show(0);
@@ -167,26 +180,92 @@ void wayfire_panel::resize(uint32_t w, uint32_t h)
 
     cairo_destroy(cr);
 
+    if (repaint_callback)
+        wl_callback_destroy(repaint_callback);
+    repaint_callback = nullptr;
+
     delete_window(window);
     setup_window();
 
     for_each_widget(w)
         w->cr = cairo_create(window->cairo_surface);
 
-    for_each_widget(w)
-        w->update(true);
+    /* the output scale might have changed */
+    text_cache_clear();
+
+    need_fullredraw = true;
+    repaint();
+}
+
+void wayfire_panel::start_waiting(int delay)
+{
+    loop_remove_timer(wait_timer);
+    wait_timer = loop_add_timer(delay, [=] ()
+    {
+        wait_timer = -1;
+        state &= ~WAITING;
+        start_animating();
+    });
+}
+
+/* the panel moves with about 5px per frame */
+static const int animation_speed = 300;
+
+/* frame callbacks are requested only while the panel is moving */
+void wayfire_panel::start_animating()
+{
+    loop_remove_timer(wait_timer);
+    wait_timer = -1;
 
-    render_frame(true);
+    if (wayfire_shell_get_version(display.wfshell) <
+        WAYFIRE_SHELL_ANIMATE_PANEL_SINCE_VERSION)
+    {
+        state |= ANIMATING;
+        add_callback(false);
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    int duration = std::abs(animation.target - animation.y) * 1000 / animation_speed;
+
+    /* reversing a running animation, the compositor starts from the
+     * current position, so it takes about as long as it has run */
+    if (animation_timer != -1)
+    {
+        duration = std::chrono::duration_cast<std::chrono::milliseconds>
+            (now - animation_start).count();
+        duration = std::min(duration, animation_duration);
+        loop_remove_timer(animation_timer);
+    }
+
+    state |= ANIMATING;
+    animation_start = now;
+    animation_duration = duration;
+
+    wayfire_shell_animate_panel(display.wfshell, output, window->surface,
+            0, animation.target, duration, WAYFIRE_SHELL_PANEL_CURVE_EASE_OUT);
+
+    animation_timer = loop_add_timer(duration, [=] ()
+    {
+        animation_timer = -1;
+        finish_animating();
+    });
 }
 
-static inline void set_timer_target(timeval& timer, int delay)
+void wayfire_panel::finish_animating()
 {
-    gettimeofday(&timer, 0);
-    timer.tv_usec += delay * 1000;
+    animation.y = animation.target;
+    if (state & HIDDEN)
+    {
+        state = SHOWN;
 
-    const int usec_in_sec = 1000000;
-    timer.tv_sec += timer.tv_usec / usec_in_sec;
-    timer.tv_usec %= usec_in_sec;
+        if (!count_input && autohide)
+            hide(300);
+    }
+    else
+    {
+        state = HIDDEN;
+    }
 }
 
 void wayfire_panel::show(int delay)
@@ -197,15 +276,18 @@ void wayfire_panel::show(int delay)
         animation.dy = 5;
     }
 
+    /* widgets which changed while the panel was hidden */
+    if (!dirty_widgets.empty())
+        schedule_repaint(nullptr);
+
     if (state & SHOWN)
     {
-        state = HIDDEN | ANIMATING;
-        return;
+        state = HIDDEN;
+        start_animating();
     } else if (!(state & WAITING))
     {
         state = HIDDEN | WAITING;
-        set_timer_target(timer_target, delay);
-        add_callback(false);
+        start_waiting(delay);
     }
 }
 
@@ -220,22 +302,25 @@ void wayfire_panel::hide(int delay)
     if (state & HIDDEN)
     {
         if (state == (HIDDEN | WAITING))
+        {
             state = HIDDEN;
-        else
-            state = SHOWN | ANIMATING;
-        return;
+            loop_remove_timer(wait_timer);
+            wait_timer = -1;
+        } else
+        {
+            state = SHOWN;
+            start_animating();
+        }
     } else if (!(state & WAITING))
     {
         state = SHOWN | WAITING;
-        set_timer_target(timer_target, delay);
-        add_callback(false);
+        start_waiting(delay);
     }
 }
 
 void wayfire_panel::on_enter(uint32_t serial)
 {
     show_default_cursor(serial);
-    add_callback(false);
 }
 
 void wayfire_panel::on_leave()
@@ -263,8 +348,9 @@ void wayfire_panel::on_motion(int x, int y)
 
 void wayfire_panel::add_callback(bool swapped)
 {
+    /* a frame is already scheduled */
     if (repaint_callback)
-        wl_callback_destroy(repaint_callback);
+        return;
 
     repaint_callback = wl_surface_frame(window->surface);
     wl_callback_add_listener(repaint_callback, &frame_listener, this);
@@ -318,6 +404,7 @@ widget* wayfire_panel::create_widget_from_name(std::string name)
     {
         w->cr = cairo_create(window->cairo_surface);
         w->panel_h = height;
+        w->need_update = [=] () { schedule_repaint(w); };
         w->create();
     }
 
@@ -351,58 +438,104 @@ void wayfire_panel::init_widgets()
     init_widgets(right, PART_RIGHT);
 }
 
-void wayfire_panel::render_frame(bool first_call)
+void wayfire_panel::render_frame()
 {
-    set_active_window(window);
+    if (repaint_callback)
+        wl_callback_destroy(repaint_callback);
+    repaint_callback = nullptr;
 
-    if (state & WAITING)
-    {
-        timeval time;
-        gettimeofday(&time, 0);
+    /* not animating, or the compositor is doing it */
+    if (!(state & ANIMATING) || animation_timer != -1)
+        return;
+
+    animation.y += animation.dy;
+
+    if (animation.y * animation.dy > animation.target * animation.dy)
+        finish_animating();
+
+    wayfire_shell_configure_panel(display.wfshell, output,
+            window->surface, 0, animation.y);
+
+    if (state & ANIMATING)
+        add_callback(false);
+}
 
-        long long delta = (timer_target.tv_sec - time.tv_sec) * 1e6 +
-            (timer_target.tv_usec - time.tv_usec);
+void wayfire_panel::schedule_repaint(widget *w)
+{
+    if (w)
+        dirty_widgets.insert(w);
 
-        if (delta <= 0)
+    if (repaint_timer == -1)
+    {
+        repaint_timer = loop_add_timer(0, [=] ()
         {
-            state &= ~WAITING;
-            state |= ANIMATING;
-        }
+            repaint_timer = -1;
+            repaint();
+        });
     }
+}
 
-    if (state & ANIMATING) {
-        animation.y += animation.dy;
+/* repaint only the area of a single widget */
+void wayfire_panel::repaint_widget(widget *w, cairo_region_t *damage)
+{
+    /* launchers grow a bit when hovered, so take half of the
+     * spacing between the widgets as well */
+    int pad = widget::font_size * 0.25;
+    cairo_rectangle_int_t rect = {w->x - pad, 0, w->width + 2 * pad, (int)height};
+
+    cairo_save(w->cr);
+    cairo_identity_matrix(w->cr);
+    cairo_new_path(w->cr);
+    cairo_rectangle(w->cr, rect.x, rect.y, rect.width, rect.height);
+    cairo_clip(w->cr);
+
+    auto& bg = widget::background_color;
+    cairo_set_operator(w->cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(w->cr, bg.r, bg.g, bg.b, bg.a);
+    cairo_paint(w->cr);
+
+    w->repaint();
+    cairo_restore(w->cr);
+
+    cairo_region_union_rectangle(damage, &rect);
+}
 
-        if (animation.y * animation.dy > animation.target * animation.dy)
-        {
-            animation.y = animation.target;
-            if (state & HIDDEN)
-            {
-                state = SHOWN;
-
-                if (!count_input && autohide)
-                    hide(300);
-            }
-            else
-            {
-                state = HIDDEN;
-            }
-        }
+void wayfire_panel::repaint()
+{
+    /* the widgets aren't visible, they will be repainted when the panel is shown */
+    if (autohide && animation.target != 0 && !need_fullredraw)
+        return;
 
-        wayfire_shell_configure_panel(display.wfshell, output,
-                window->surface, 0, animation.y);
-    }
+    set_active_window(window);
+
+    bool relayout = need_fullredraw;
+    std::vector<widget*> changed;
 
-    bool should_swap = first_call;
-    if (animation.target == 0 || !autohide)
+    if (need_fullredraw)
     {
         for_each_widget(w)
-            should_swap |= w->update();
+            w->update(true);
+    } else
+    {
+        for (auto w : dirty_widgets)
+        {
+            int old_width = w->width;
+            if (w->update(false))
+                changed.push_back(w);
+
+            relayout |= (old_width != w->width);
+        }
     }
 
-    should_swap = should_swap || need_fullredraw;
+    dirty_widgets.clear();
+    if (!relayout && changed.empty())
+        return;
+
+    if (!backend_preserves_contents())
+        relayout = true;
 
-    if (should_swap)
+    auto damage = cairo_region_create();
+    if (relayout)
     {
         cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
         render_rounded_rectangle(cr, 0, 0, width, height,
@@ -415,17 +548,15 @@ void wayfire_panel::render_frame(bool first_call)
 
         for_each_widget(w)
             w->repaint();
-    }
-
-    /* we don't need to redraw only if we are autohiding and hidden now */
-    if (state != HIDDEN)
-        add_callback(should_swap);
 
-    if (should_swap)
-        damage_commit_window(window);
+        cairo_rectangle_int_t full = {0, 0, (int)width, (int)height};
+        cairo_region_union_rectangle(damage, &full);
+    } else
+    {
+        for (auto w : changed)
+            repaint_widget(w, damage);
+    }
 
-    /* don't repaint too often if there is no interaction with the panel,
-     * otherwise the panel eats up some CPU power */
-    if (((state & (WAITING | ANIMATING)) == 0) && count_input <= 0)
-        usleep(1e6/10);
+    damage_commit_window(window, damage);
+    cairo_region_destroy(damage);
 }
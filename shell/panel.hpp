@@ -3,12 +3,14 @@
 
 #include "window.hpp"
 #include <vector>
+#include <set>
+#include <chrono>
 
 struct widget;
 class wayfire_config;
 
 class wayfire_panel {
-    wl_callback *repaint_callback;
+    wl_callback *repaint_callback = nullptr;
     cairo_t *cr;
 
     uint32_t output;
@@ -23,7 +25,8 @@ class wayfire_panel {
         int y, target;
     } animation;
 
-    timeval timer_target;
+    /* the delay before starting to show/hide the panel */
+    int wait_timer = -1;
     enum animation_state
     { WAITING = (1 << 0),
       ANIMATING = (1 << 1),
@@ -32,8 +35,17 @@ class wayfire_panel {
     };
     uint32_t state = HIDDEN;
 
+    /* with wayfire_shell v2 the compositor slides the panel itself,
+     * the timer fires when it has arrived */
+    int animation_timer = -1;
+    int animation_duration = 0;
+    std::chrono::steady_clock::time_point animation_start;
+
     void show(int delay_ms);
     void hide(int delay_ms);
+    void start_waiting(int delay_ms);
+    void start_animating();
+    void finish_animating();
 
     int count_input = 0;
     void on_enter(uint32_t);
@@ -47,6 +59,13 @@ class wayfire_panel {
     std::vector<widget*> widgets[3];
 #define for_each_widget(w) for(int i = 0; i < 3; i++) for (auto w : widgets[i])
 
+    /* widgets which requested an update since the last repaint */
+    std::set<widget*> dirty_widgets;
+    int repaint_timer = -1;
+    void schedule_repaint(widget *w);
+    void repaint();
+    void repaint_widget(widget *w, cairo_region_t *damage);
+
     widget *create_widget_from_name(std::string name);
     enum position_policy
     {
@@ -73,7 +92,7 @@ class wayfire_panel {
         wayfire_panel(wayfire_config *config);
         ~wayfire_panel();
         void create_panel(uint32_t output, uint32_t width, uint32_t height);
-        void render_frame(bool first_call = false);
+        void render_frame();
         void set_autohide(bool ah);
 
         void resize(uint32_t width, uint32_t height);
@@ -14,6 +14,8 @@
 
 #include <cairo.h>
 
+#include <vector>
+
 #include "config.h"
 #include "window.hpp"
 
@@ -33,39 +35,6 @@ struct shm_pool
 	void *data;
 };
 
-struct shm_surface_data
-{
-	wl_buffer *buffer;
-	shm_pool *pool;
-};
-
-struct shm_window : wayfire_window
-{
-	rectangle rect;
-};
-
-const cairo_user_data_key_t shm_surface_data_key = {0};
-
- wl_buffer* get_buffer_from_cairo_surface(cairo_surface_t *surface)
-{
-	auto data = static_cast<shm_surface_data*>
-        (cairo_surface_get_user_data(surface, &shm_surface_data_key));
-
-	return data->buffer;
-}
-
-void shm_pool_destroy(shm_pool *pool);
-
-void shm_surface_data_destroy(void *p)
-{
-	auto data = static_cast<shm_surface_data*> (p);
-	wl_buffer_destroy(data->buffer);
-	if (data->pool)
-		shm_pool_destroy(data->pool);
-
-    delete data;
-}
-
 int set_cloexec_or_close(int fd)
 {
 	long flags;
@@ -209,54 +178,166 @@ inline int data_length_for_shm_surface(rectangle *rect)
     return cairo_format_stride_for_width(target_fmt, rect->width) * rect->height;
 }
 
-cairo_surface_t * create_shm_surface_from_pool(void *none, rectangle *rectangle, shm_pool *pool)
+/* the compositor may still read a buffer after it has been committed, so
+ * we cycle between up to max_buffers buffers from the same pool */
+static const int max_buffers = 3;
+
+struct shm_window;
+struct shm_buffer
 {
-    cairo_surface_t *surface;
+    shm_window *window;
+    wl_buffer *buffer;
+    unsigned char *data;
 
-    auto data = new shm_surface_data;
-    if (data == NULL)
-        return NULL;
+    /* true between committing the buffer and the release event */
+    bool busy = false;
+
+    /* what has changed since the buffer was last updated, i.e the damage
+     * of the frames younger than the buffer age */
+    cairo_region_t *damage;
+};
 
-    int stride = cairo_format_stride_for_width (target_fmt, rectangle->width);
-    int length = stride * rectangle->height;
-    data->pool = NULL;
+struct shm_window : wayfire_window
+{
+    rectangle rect;
+    int stride;
+
+    shm_pool *pool;
+    std::vector<shm_buffer*> buffers;
+
+    /* damage since the last commit */
+    cairo_region_t *surface_damage;
+    /* all buffers were busy, commit as soon as one is released */
+    bool commit_pending = false;
+};
+
+void commit_window(shm_window *window);
+
+static void buffer_release(void *data, wl_buffer *)
+{
+    auto buffer = static_cast<shm_buffer*> (data);
+    buffer->busy = false;
+
+    if (buffer->window->commit_pending)
+        commit_window(buffer->window);
+}
+
+static const wl_buffer_listener buffer_listener = {
+    buffer_release
+};
+
+shm_buffer *create_buffer(shm_window *window)
+{
+    int length = window->stride * window->rect.height;
 
     int offset;
-    void *map = shm_pool_allocate(pool, length, &offset);
+    void *map = shm_pool_allocate(window->pool, length, &offset);
+    if (!map)
+        return nullptr;
+
+    auto buffer = new shm_buffer;
+    buffer->window = window;
+    buffer->data = (unsigned char*) map;
+    buffer->buffer = wl_shm_pool_create_buffer(window->pool->pool, offset,
+            window->rect.width, window->rect.height,
+            window->stride, WL_SHM_FORMAT_ARGB8888);
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+
+    /* a new buffer has no valid contents */
+    cairo_rectangle_int_t full = {0, 0, window->rect.width, window->rect.height};
+    buffer->damage = cairo_region_create_rectangle(&full);
+
+    window->buffers.push_back(buffer);
+    return buffer;
+}
 
-    if (!map) {
-        free(data);
-        return NULL;
+void destroy_buffer(shm_buffer *buffer)
+{
+    wl_buffer_destroy(buffer->buffer);
+    cairo_region_destroy(buffer->damage);
+    delete buffer;
+}
+
+shm_buffer *get_free_buffer(shm_window *window)
+{
+    for (auto buffer : window->buffers)
+    {
+        if (!buffer->busy)
+            return buffer;
     }
 
-    surface = cairo_image_surface_create_for_data ((unsigned char*) map,
-            target_fmt,
-            rectangle->width,
-            rectangle->height,
-            stride);
+    if ((int)window->buffers.size() < max_buffers)
+        return create_buffer(window);
 
-    cairo_surface_set_user_data(surface, &shm_surface_data_key,
-            data, shm_surface_data_destroy);
+    return nullptr;
+}
+
+/* copy what has changed since the buffer was last used from the
+ * cairo surface we draw on and commit only the new damage */
+void commit_window(shm_window *window)
+{
+    auto buffer = get_free_buffer(window);
+    if (!buffer)
+    {
+        window->commit_pending = true;
+        return;
+    }
+
+    window->commit_pending = false;
+    cairo_surface_flush(window->cairo_surface);
+    auto src = cairo_image_surface_get_data(window->cairo_surface);
+
+    int n = cairo_region_num_rectangles(buffer->damage);
+    for (int i = 0; i < n; i++)
+    {
+        cairo_rectangle_int_t rect;
+        cairo_region_get_rectangle(buffer->damage, i, &rect);
+
+        size_t offset = rect.y * window->stride + rect.x * 4;
+        for (int y = 0; y < rect.height; y++, offset += window->stride)
+            memcpy(buffer->data + offset, src + offset, rect.width * 4);
+    }
+
+    cairo_region_subtract(buffer->damage, buffer->damage);
 
-    data->buffer = wl_shm_pool_create_buffer(pool->pool, offset,
-            rectangle->width,
-            rectangle->height,
-            stride, WL_SHM_FORMAT_ARGB8888);
+    wl_surface_attach(window->surface, buffer->buffer, 0, 0);
 
-    return surface;
+    /* wl_surface.damage is in surface coordinates */
+    n = cairo_region_num_rectangles(window->surface_damage);
+    for (int i = 0; i < n; i++)
+    {
+        cairo_rectangle_int_t rect;
+        cairo_region_get_rectangle(window->surface_damage, i, &rect);
+
+        int x1 = rect.x / window->scale, y1 = rect.y / window->scale;
+        int x2 = (rect.x + rect.width + window->scale - 1) / window->scale;
+        int y2 = (rect.y + rect.height + window->scale - 1) / window->scale;
+        wl_surface_damage(window->surface, x1, y1, x2 - x1, y2 - y1);
+    }
+
+    cairo_region_subtract(window->surface_damage, window->surface_damage);
+
+    wl_surface_commit(window->surface);
+    buffer->busy = true;
 }
 
 wayfire_window* create_window(uint32_t w, uint32_t h)
 {
-    shm_surface_data *data;
-    shm_pool *pool;
-
     shm_window *window = new shm_window;
 
     window->rect.x = 0;
     window->rect.y = 0;
     window->rect.width = w;
     window->rect.height = h;
+    window->stride = cairo_format_stride_for_width(target_fmt, w);
+
+    window->pool = shm_pool_create(display.shm,
+            max_buffers * data_length_for_shm_surface(&window->rect));
+    if (!window->pool)
+    {
+        delete window;
+        return NULL;
+    }
 
 	window->surface = wl_compositor_create_surface(display.compositor);
     wl_surface_set_user_data(window->surface, window);
@@ -265,22 +346,10 @@ wayfire_window* create_window(uint32_t w, uint32_t h)
 	wl_shell_surface_add_listener(window->shell_surface, &shell_surface_listener, window);
 	wl_shell_surface_set_toplevel(window->shell_surface);
 
-    pool = shm_pool_create(display.shm, data_length_for_shm_surface(&window->rect));
-    if (!pool)
-        return NULL;
-
-    window->cairo_surface =
-        create_shm_surface_from_pool(display.shm, &window->rect, pool);
-
-    if (!window->cairo_surface)
-    {
-        shm_pool_destroy(pool);
-        return NULL;
-    }
-
-    /* make sure we destroy the pool when the surface is destroyed */
-    data = (shm_surface_data*) cairo_surface_get_user_data(window->cairo_surface, &shm_surface_data_key);
-    data->pool = pool;
+    /* the clients draw on a surface in ordinary memory, it is copied to
+     * the shm buffers on commit */
+    window->cairo_surface = cairo_image_surface_create(target_fmt, w, h);
+    window->surface_damage = cairo_region_create();
 
     return window;
 }
@@ -292,19 +361,39 @@ void set_active_window(wayfire_window *w)
 void backend_delete_window (wayfire_window *w)
 {
     auto window = static_cast<shm_window*> (w);
+
+    for (auto buffer : window->buffers)
+        destroy_buffer(buffer);
+
+    shm_pool_destroy(window->pool);
+    cairo_region_destroy(window->surface_damage);
     delete window;
 }
 
+void damage_commit_window(wayfire_window *w, cairo_region_t *damage)
+{
+    auto window = static_cast<shm_window*> (w);
+
+    cairo_region_union(window->surface_damage, damage);
+    for (auto buffer : window->buffers)
+        cairo_region_union(buffer->damage, damage);
+
+    commit_window(window);
+}
+
 void damage_commit_window(wayfire_window *w)
 {
     auto window = static_cast<shm_window*> (w);
 
-    wl_surface_attach(window->surface, get_buffer_from_cairo_surface(window->cairo_surface),0,0);
-    wl_surface_damage(window->surface, window->rect.x, 
-            window->rect.y,
-            window->rect.width,
-            window->rect.height);
-    wl_surface_commit(window->surface);
+    cairo_rectangle_int_t full = {0, 0, window->rect.width, window->rect.height};
+    auto damage = cairo_region_create_rectangle(&full);
+    damage_commit_window(window, damage);
+    cairo_region_destroy(damage);
+}
+
+bool backend_preserves_contents()
+{
+    return true;
 }
 
 bool setup_backend()
@@ -4,10 +4,14 @@
 #include <cstdio>
 #include <cassert>
 #include <fstream>
-#include <sys/time.h>
+#include <iostream>
+#include <vector>
 #include <sys/stat.h>
-#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include "window.hpp"
+#include "text-cache.hpp"
+#include "event-loop.hpp"
 #include "../proto/wayfire-shell-client.h"
 
 #include <asoundlib.h>
@@ -18,6 +22,9 @@ struct audio_data
     snd_mixer_t *handle;
     snd_mixer_elem_t *elem;
     long min, max;
+
+    /* the descriptors ALSA asked us to poll */
+    std::vector<pollfd> fds;
 } audata;
 
 void setup_audio()
@@ -43,41 +50,19 @@ void cleanup_audio()
     snd_mixer_close(audata.handle);
 }
 
-int tar_level = -1;
-
 int get_audio_level()
 {
-    setup_audio();
-
-    float dta = -1;
-
-    if (tar_level == -1)
-    {
-
-        long volume;
-        snd_mixer_selem_get_playback_volume(audata.elem, (snd_mixer_selem_channel_id_t)0, &volume);
-        volume -= audata.min;
-
-        dta =  1. * volume / (audata.max - audata.min) * 100.f;
-    } else
-    {
-        dta = tar_level;
-        long volume = audata.min + (audata.max - audata.min) * tar_level / 100;
-        snd_mixer_selem_set_playback_volume_all(audata.elem, volume);
-
-        tar_level = -1;
-    }
-
+    long volume;
+    snd_mixer_selem_get_playback_volume(audata.elem, (snd_mixer_selem_channel_id_t)0, &volume);
+    volume -= audata.min;
 
-    cleanup_audio();
-    return dta + 0.5;
+    return 1. * volume / (audata.max - audata.min) * 100.f + 0.5;
 }
 
-timeval get_current_time()
+void set_audio_level(int level)
 {
-    timeval time;
-    gettimeofday(&time, 0);
-    return time;
+    long volume = audata.min + (audata.max - audata.min) * level / 100;
+    snd_mixer_selem_set_playback_volume_all(audata.elem, volume);
 }
 
 const char *lock_file = "/tmp/.wayfire-sound-lock";
@@ -97,6 +82,8 @@ void create_lock_file()
 
 void cleanup()
 {
+    cleanup_audio();
+    loop_fini();
     finish_wayland_connection();
     remove(lock_file);
 }
@@ -108,7 +95,6 @@ cairo_t *cr = nullptr;
 int input_count = 0;
 const int input_pointer_button = (1 << 31);
 const int input_input_focus = (1 << 30);
-timeval start_time;
 
 struct
 {
@@ -116,16 +102,21 @@ struct
 } geometry, bar_geometry;
 
 int alpha = 0;
-int step = 1;
-int cur_level = -1;
+int level = 0, cur_level = -1;
 
-long inactive_time_mms = 1e6;
+int inactive_time_ms = 1000;
+int inactive_timer = -1;
 
-bool fade_in = true;
+enum fade_state
+{
+    FADE_NONE,
+    FADE_IN,
+    FADE_OUT
+};
+fade_state fade = FADE_IN;
 
 void render_frame();
-void redraw_handler(void *data, wl_callback*, uint32_t)
-{ render_frame(); }
+void redraw_handler(void *data, wl_callback*, uint32_t);
 
 static const struct wl_callback_listener frame_listener = { redraw_handler };
 
@@ -133,49 +124,118 @@ static wl_callback *repaint_callback = nullptr;
 void add_callback()
 {
     if (repaint_callback)
-        wl_callback_destroy(repaint_callback);
+        return;
 
     repaint_callback = wl_surface_frame(window->surface);
     wl_callback_add_listener(repaint_callback, &frame_listener, window);
 }
 
-void render_frame()
+/* the popup is redrawn only while fading or while the bar moves
+ * towards the new level, one step per frame */
+void redraw_handler(void *data, wl_callback*, uint32_t)
 {
-    if (fade_in)
+    wl_callback_destroy(repaint_callback);
+    repaint_callback = nullptr;
+
+    if (fade == FADE_IN)
     {
         alpha += 1;
         if (alpha >= 8)
         {
             alpha = 8;
-            fade_in = 0;
+            fade = FADE_NONE;
+        }
+    } else if (fade == FADE_OUT)
+    {
+        alpha -= 1;
+        if (alpha <= 0)
+        {
+            cleanup();
+            std::exit(0);
         }
     }
 
-    auto ctime = get_current_time();
-    auto level = get_audio_level();
+    if (std::abs(cur_level - level) < 3)
+        cur_level = level;
+    else
+        cur_level = (2 * cur_level + 3 * level) / 5;
 
-    if (cur_level != level || input_count)
-    {
-        start_time = get_current_time();
+    render_frame();
+}
 
-        fade_in = true;
-    }
+void schedule_redraw()
+{
+    /* the next frame callback will redraw anyway */
+    if (repaint_callback)
+        return;
 
-    long long elapsed = (ctime.tv_sec - start_time.tv_sec) * 1e6 + (ctime.tv_usec - start_time.tv_usec);
-    if (elapsed > inactive_time_mms)
+    render_frame();
+}
+
+void restart_inactive_timer()
+{
+    loop_remove_timer(inactive_timer);
+    inactive_timer = loop_add_timer(inactive_time_ms, [] ()
     {
-        fade_in = false;
-        alpha -= 1;
-        if (alpha == 0)
+        inactive_timer = -1;
+
+        /* the user is still interacting with the popup */
+        if (input_count)
         {
-            cleanup();
-            std::exit(0);
+            restart_inactive_timer();
+            return;
         }
-    } else if (!fade_in)
+
+        fade = FADE_OUT;
+        schedule_redraw();
+    });
+}
+
+/* show the popup again after a level change or input */
+void on_activity()
+{
+    if (fade == FADE_OUT || alpha < 8)
+        fade = FADE_IN;
+
+    restart_inactive_timer();
+    schedule_redraw();
+}
+
+/* poll() and epoll() use the same event bits on Linux */
+void on_mixer_event(int fd, uint32_t events)
+{
+    /* ALSA may have to translate the events of its descriptors */
+    auto fds = audata.fds;
+    for (auto& pfd : fds)
+        pfd.revents = (pfd.fd == fd) ? (events & 0xffff) : 0;
+
+    unsigned short revents = 0;
+    if (snd_mixer_poll_descriptors_revents(audata.handle, fds.data(), fds.size(), &revents) < 0)
+        return;
+
+    if (revents & (POLLERR | POLLHUP))
+    {
+        std::cerr << "sound-popup: mixer device error, not watching it anymore" << std::endl;
+        for (auto& pfd : audata.fds)
+            loop_remove_fd(pfd.fd);
+        return;
+    }
+
+    if (!(revents & POLLIN))
+        return;
+
+    snd_mixer_handle_events(audata.handle);
+
+    int new_level = get_audio_level();
+    if (new_level != level)
     {
-        usleep(1e6/15);
+        level = new_level;
+        on_activity();
     }
+}
 
+void render_frame()
+{
     cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
     render_rounded_rectangle(cr, 0, 0, geometry.w, geometry.h,
                              0.02 * geometry.w, 0.022, 0.028, 0.032, alpha / 10.f);
@@ -186,15 +246,11 @@ void render_frame()
 
     cairo_set_source_rgba(cr, 1, 1, 1, 1.25 * alpha / 10.f);
     float font_size = geometry.h * 0.4;
-    cairo_set_font_size(cr, font_size);
-
-    cairo_text_extents_t te;
-    cairo_text_extents(cr, " 100% ", &te);
 
+    auto te = text_cache_extents(NULL, font_size, " 100% ");
     float y = (geometry.h + te.height) / 2.0;
 
-    cairo_move_to(cr, 0, y);
-    cairo_show_text(cr, label.c_str());
+    text_cache_show(cr, NULL, font_size, 0, y, label);
 
     cairo_set_source_rgba(cr, 0.3, 0.7, 1.0, 1.25 * alpha / 10.f);
     float x = te.x_advance;
@@ -205,13 +261,6 @@ void render_frame()
     float bar_height = font_size * 0.8;
     y = (geometry.h - bar_height) / 2.0;
 
-    if (std::abs(cur_level - level) < 3)
-        cur_level = level;
-    else
-    {
-        cur_level = (2 * cur_level + 3 * level) / 5;
-    }
-
     float bar_width = geometry.w * 0.96 - te.x_advance;
     float vol_width = bar_width * cur_level / 100.f;
 
@@ -228,7 +277,8 @@ void render_frame()
     cairo_fill(cr);
     cairo_new_path(cr);
 
-    add_callback();
+    if (fade != FADE_NONE || cur_level != level)
+        add_callback();
     damage_commit_window(window);
 }
 
@@ -243,10 +293,13 @@ void handle_input(int x, int y)
     double d = x - bar_geometry.x;
     d /= bar_geometry.w;
 
-    tar_level = 100 * d;
+    int target = 100 * d;
+    target = std::min(target, 100);
+    target = std::max(target, 0);
 
-    tar_level = std::min(tar_level, 100);
-    tar_level = std::max(tar_level, 0);
+    set_audio_level(target);
+    level = get_audio_level();
+    on_activity();
 }
 
 void setup_window()
@@ -333,16 +386,31 @@ int main(int argc, char **argv)
     }
 
     if (argc >= 6)
-        inactive_time_mms = std::atoi(argv[5]) * 1000;
+        inactive_time_ms = std::atoi(argv[5]);
+
+    if (!loop_init(display.wl_disp))
+        return -1;
 
     setup_audio();
-    setup_window();
-    render_frame();
 
-    while(true) {
-        if (wl_display_dispatch(display.wl_disp) < 0)
-            break;
+    /* get notified about volume changes from the mixer instead of polling it */
+    int count = snd_mixer_poll_descriptors_count(audata.handle);
+    audata.fds.resize(std::max(count, 0));
+    count = snd_mixer_poll_descriptors(audata.handle, audata.fds.data(), audata.fds.size());
+    audata.fds.resize(std::max(count, 0));
+
+    for (auto& pfd : audata.fds)
+    {
+        int fd = pfd.fd;
+        loop_add_fd(fd, pfd.events, [fd] (uint32_t events) { on_mixer_event(fd, events); });
     }
 
+    level = get_audio_level();
+
+    setup_window();
+    restart_inactive_timer();
+    render_frame();
+
+    loop_run();
     cleanup();
 }
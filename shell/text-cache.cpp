@@ -0,0 +1,156 @@
+#include "text-cache.hpp"
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+using text_key = std::tuple<std::string, double, cairo_font_face_t*>;
+
+struct text_run
+{
+    cairo_text_extents_t extents;
+
+    /* the rasterised run, positioned at (offset_x, offset_y)
+     * relative to the start of its baseline */
+    cairo_surface_t *mask = nullptr;
+    int offset_x, offset_y;
+};
+
+/* above this many entries the cache is simply flushed */
+static const size_t max_cached = 256;
+
+static std::map<text_key, text_run> runs;
+static std::map<text_key, cairo_text_extents_t> extents;
+
+/* used only for measuring text */
+static cairo_t *measure_cr = nullptr;
+
+static void set_font(cairo_t *cr, cairo_font_face_t *face, double size)
+{
+    if (face)
+        cairo_set_font_face(cr, face);
+    cairo_set_font_size(cr, size);
+}
+
+static cairo_text_extents_t measure(cairo_font_face_t *face, double size,
+        const std::string& text)
+{
+    if (!measure_cr)
+    {
+        auto surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+        measure_cr = cairo_create(surface);
+        cairo_surface_destroy(surface);
+    }
+
+    cairo_save(measure_cr);
+    set_font(measure_cr, face, size);
+
+    cairo_text_extents_t te;
+    cairo_text_extents(measure_cr, text.c_str(), &te);
+    cairo_restore(measure_cr);
+
+    return te;
+}
+
+static const text_run& get_run(cairo_font_face_t *face, double size,
+        const std::string& text)
+{
+    text_key key{text, size, face};
+
+    auto it = runs.find(key);
+    if (it != runs.end())
+        return it->second;
+
+    if (runs.size() >= max_cached)
+        text_cache_clear();
+
+    text_run& run = runs[key];
+    run.extents = measure(face, size, text);
+
+    int w = std::ceil(run.extents.width) + 2;
+    int h = std::ceil(run.extents.height) + 2;
+    if (text.empty() || run.extents.width <= 0 || run.extents.height <= 0)
+        return run;
+
+    run.offset_x = std::floor(run.extents.x_bearing) - 1;
+    run.offset_y = std::floor(run.extents.y_bearing) - 1;
+
+    run.mask = cairo_image_surface_create(CAIRO_FORMAT_A8, w, h);
+    auto cr = cairo_create(run.mask);
+    set_font(cr, face, size);
+    cairo_set_source_rgba(cr, 0, 0, 0, 1);
+    cairo_move_to(cr, -run.offset_x, -run.offset_y);
+    cairo_show_text(cr, text.c_str());
+    cairo_destroy(cr);
+
+    cairo_surface_flush(run.mask);
+    return run;
+}
+
+static std::vector<std::string> split_runs(const std::string& text)
+{
+    std::vector<std::string> result(1);
+    for (auto c : text)
+    {
+        if (c == ' ')
+            result.emplace_back();
+        else
+            result.back() += c;
+    }
+
+    return result;
+}
+
+cairo_text_extents_t text_cache_extents(cairo_font_face_t *face, double size,
+        const std::string& text)
+{
+    text_key key{text, size, face};
+
+    auto it = extents.find(key);
+    if (it != extents.end())
+        return it->second;
+
+    if (extents.size() >= max_cached)
+        extents.clear();
+
+    return extents[key] = measure(face, size, text);
+}
+
+void text_cache_show(cairo_t *cr, cairo_font_face_t *face, double size,
+        double x, double y, const std::string& text)
+{
+    double space = get_run(face, size, " ").extents.x_advance;
+
+    /* the runs are composited at whole pixels, as glyphs would be */
+    double pen = x;
+    y = std::round(y);
+
+    bool first = true;
+    for (auto& str : split_runs(text))
+    {
+        if (!first)
+            pen += space;
+        first = false;
+
+        if (str.empty())
+            continue;
+
+        auto& run = get_run(face, size, str);
+        if (run.mask)
+            cairo_mask_surface(cr, run.mask, std::round(pen) + run.offset_x, y + run.offset_y);
+
+        pen += run.extents.x_advance;
+    }
+}
+
+void text_cache_clear()
+{
+    for (auto& r : runs)
+    {
+        if (r.second.mask)
+            cairo_surface_destroy(r.second.mask);
+    }
+
+    runs.clear();
+    extents.clear();
+}
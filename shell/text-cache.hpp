@@ -0,0 +1,27 @@
+#ifndef TEXT_CACHE_HPP
+#define TEXT_CACHE_HPP
+
+#include <string>
+#include <cairo.h>
+
+/* Rendered text is cached, keyed by (string, font size, font face), so that
+ * repainting an unchanged string doesn't shape and rasterise it again.
+ * Strings are split at spaces into runs, each run is rasterised once into an
+ * A8 mask, so when only a part of the string changes(for ex. the minutes of
+ * the clock) only that part is rendered again.
+ *
+ * face can be NULL, in which case cairo's default font is used. */
+
+/* the same as cairo_text_extents() for the whole string */
+cairo_text_extents_t text_cache_extents(cairo_font_face_t *face, double size,
+        const std::string& text);
+
+/* draw text with the current source and operator of cr,
+ * the baseline starting at (x, y) in user coordinates */
+void text_cache_show(cairo_t *cr, cairo_font_face_t *face, double size,
+        double x, double y, const std::string& text);
+
+/* must be called when the output scale changes */
+void text_cache_clear();
+
+#endif /* end of include guard: TEXT_CACHE_HPP */
@@ -1,5 +1,7 @@
 #include "widgets.hpp"
 #include "window.hpp"
+#include "event-loop.hpp"
+#include "text-cache.hpp"
 
 #include <iostream>
 #include <chrono>
@@ -10,9 +12,6 @@
 #include <wayland-client.h>
 #include <linux/input-event-codes.h>
 #include <gio/gio.h>
-#include <glib-unix.h>
-#include <mutex>
-#include <thread>
 
 #include <sys/dir.h>
 #include <dirent.h>
@@ -48,14 +47,43 @@ void load_default_font()
     cairo_font_face = cairo_ft_font_face_create_for_ft_face (face, 0);
 }
 
-/* -------------------- Clock widget ----------------- */
-void clock_widget::create()
+int widget_model::subscribe(std::function<void()> callback)
 {
-    load_default_font();
-    width = font_size * 18;
-    this->current_text = "";
+    int id = (listeners.empty() ? 0 : (--listeners.end())->first) + 1;
+    listeners[id] = callback;
+    return id;
+}
+
+void widget_model::unsubscribe(int id)
+{
+    listeners.erase(id);
+}
+
+void widget_model::notify()
+{
+    for (auto& l : listeners)
+        l.second();
+}
+
+cairo_surface_t *load_cached_image(std::string path)
+{
+    /* the cache holds one reference to each surface */
+    static std::map<std::string, cairo_surface_t*> cache;
+
+    auto it = cache.find(path);
+    if (it != cache.end())
+        return cairo_surface_reference(it->second);
+
+    auto img = cairo_try_load_png(path.c_str());
+    if (!img)
+        return nullptr;
+
+    cache[path] = img;
+    return cairo_surface_reference(img);
 }
 
+/* -------------------- Clock widget ----------------- */
+
 const std::string months[] = {
     "January",
     "February",
@@ -80,27 +108,79 @@ std::string format(int x)
     }
 }
 
-bool clock_widget::update(bool reset)
+/* the current time, formatted once for all panels */
+struct clock_model : public widget_model
 {
-    using std::chrono::system_clock;
+    std::string text;
+    int timer = 0;
+
+    clock_model()
+    {
+        update();
+    }
 
-    time_t now = system_clock::to_time_t(system_clock::now());
-    auto time = std::localtime(&now);
+    ~clock_model()
+    {
+        loop_remove_timer(timer);
+    }
 
-    std::string time_string = std::to_string(time->tm_mday) + " " +
-        months[time->tm_mon] + " " + format(time->tm_hour) +
-        ":" + format(time->tm_min);
-    if (time_string != this->current_text || reset)
+    /* the clock shows only hours and minutes, so wake up exactly
+     * on the second the minute changes */
+    void update()
     {
-        current_text = time_string;
+        using namespace std::chrono;
+
+        auto now = system_clock::now();
+        time_t now_t = system_clock::to_time_t(now);
+        auto time = std::localtime(&now_t);
+
+        text = std::to_string(time->tm_mday) + " " +
+            months[time->tm_mon] + " " + format(time->tm_hour) +
+            ":" + format(time->tm_min);
+
+        auto ms = duration_cast<milliseconds>(now.time_since_epoch()).count() % 1000;
+        int timeout = (60 - time->tm_sec) * 1000 - ms;
+
+        timer = loop_add_timer(timeout, [=] ()
+        {
+            update();
+            notify();
+        });
+    }
+};
+
+clock_model *clock_widget::model = nullptr;
+
+void clock_widget::create()
+{
+    if (!model)
+        model = new clock_model();
 
-        cairo_set_font_size(cr, font_size);
-        cairo_set_font_face(cr, cairo_font_face);
+    id = model->subscribe(need_update);
 
-        cairo_text_extents_t te;
-        cairo_text_extents(cr, current_text.c_str(), &te);
+    load_default_font();
+    width = font_size * 18;
+    this->current_text = "";
+}
+
+clock_widget::~clock_widget()
+{
+    model->unsubscribe(id);
 
-        width = te.width;
+    /* the last clock is gone, stop the timer with the model */
+    if (model->listeners.empty())
+    {
+        delete model;
+        model = nullptr;
+    }
+}
+
+bool clock_widget::update(bool reset)
+{
+    if (model->text != this->current_text || reset)
+    {
+        current_text = model->text;
+        width = text_cache_extents(cairo_font_face, font_size, current_text).width;
 
         return true;
     } else
@@ -111,13 +191,10 @@ bool clock_widget::update(bool reset)
 
 void clock_widget::repaint()
 {
-    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0); /* blank to white */
-
     cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
     cairo_set_source_rgb(cr, 0.91, 0.918, 0.965);
 
-    cairo_move_to(cr, x, font_size);
-    cairo_show_text(cr, current_text.c_str());
+    text_cache_show(cr, cairo_font_face, font_size, x, font_size, current_text);
 }
 
 /* --------------- Battery widget ---------------------- */
@@ -125,17 +202,33 @@ std::string battery_options::icon_path_prefix;
 bool battery_options::invert_icons;
 float battery_options::text_scale;
 
-struct battery_info
+cairo_surface_t* prepare_icon(std::string path);
+
+struct battery_info : public widget_model
 {
     std::string icon;
     int percentage;
 
+    /* the icon is prepared once, not per panel */
+    cairo_surface_t *icon_surface = nullptr;
+
     /* currently unused, once popups have been implemented,
      * it will be used to show time to fill */
     bool charging;
 
-    std::map<int, bool> percentage_updated, icon_updated;
-    std::mutex mutex;
+    void set_icon(std::string path)
+    {
+        if (path == icon)
+            return;
+
+        if (icon_surface)
+            cairo_surface_destroy(icon_surface);
+        icon_surface = nullptr;
+
+        icon = path;
+        if (icon != "none")
+            icon_surface = prepare_icon(icon);
+    }
 };
 
 static std::string
@@ -184,41 +277,23 @@ on_battery_changed (GDBusProxy          *proxy,
         {
             if (std::string(key) == "Percentage")
             {
-                info->mutex.lock();
                 info->percentage = g_variant_get_double(value);
-                for (auto& p : info->percentage_updated)
-                    p.second = true;
-                info->mutex.unlock();
             } else if (std::string(key) == "IconName")
             {
                 gsize n;
-                info->mutex.lock();
-                info->icon = find_battery_icon_path(g_variant_get_string(value, &n));
-                for (auto& p : info->icon_updated)
-                    p.second = true;
-                info->mutex.unlock();
+                info->set_icon(find_battery_icon_path(g_variant_get_string(value, &n)));
             } else if (std::string(key) == "State")
             {
                 uint32_t state = g_variant_get_uint32(value);
-
-                info->mutex.lock();
                 info->charging = (state == 1) || (state == 5);
-                for (auto& p : info->percentage_updated)
-                    p.second = true;
-                info->mutex.unlock();
             }
         }
 
         g_variant_iter_free(iter);
+        info->notify();
     }
 }
 
-static gboolean handle_exit_signal(gpointer data)
-{
-    g_main_loop_quit((GMainLoop*) data);
-    return G_SOURCE_REMOVE;
-}
-
 struct upower_backend
 {
     GDBusConnection *dbus_connection;
@@ -328,39 +403,21 @@ struct upower_backend
 
         this->info = info;
 
-        info->mutex.lock();
         info->charging = (state == 1) || (state == 5);
-        info->icon = icon;
+        info->set_icon(icon);
         info->percentage = percentage;
 
-        for (auto& p : info->percentage_updated)
-            p.second = true;
-        for (auto& p : info->icon_updated)
-            p.second = true;
-        info->mutex.unlock();
-
-        return true;
-    }
-
-    void start_loop()
-    {
+        /* the signal is dispatched by the shell's main loop */
         g_signal_connect(battery_proxy,
                 "g-properties-changed", G_CALLBACK(on_battery_changed), info);
 
-        auto loop = g_main_loop_new(NULL, FALSE);
-        g_unix_signal_add(SIGUSR1, handle_exit_signal, loop);
-
-        g_main_loop_run(loop);
-
-        g_object_unref(upower_proxy);
-        g_main_loop_unref(loop);
+        return true;
     }
 };
 
 
 battery_info   *battery_widget::info;
 upower_backend *battery_widget::backend = nullptr;
-std::thread     battery_widget::backend_thread;
 
 void battery_widget::create()
 {
@@ -375,19 +432,15 @@ void battery_widget::create()
 
             delete backend;
             delete info;
+            backend = nullptr;
+            info = nullptr;
 
             active = false;
             return;
         }
-
-        backend_thread = std::thread([=] () { backend->start_loop(); });
     }
 
-    info->mutex.lock();
-    id = (info->percentage_updated.empty() ? 0 : (--info->percentage_updated.end())->first) + 1;
-    info->percentage_updated[id] = true;
-    info->icon_updated[id] = true;
-    info->mutex.unlock();
+    id = info->subscribe(need_update);
 
     load_default_font();
 
@@ -401,10 +454,10 @@ void battery_widget::create()
 
 battery_widget::~battery_widget()
 {
-    info->mutex.lock();
-    info->percentage_updated.erase(id);
-    info->icon_updated.erase(id);
-    info->mutex.unlock();
+    if (!active)
+        return;
+
+    info->unsubscribe(id);
 }
 
 bool battery_widget::update(bool reset)
@@ -412,27 +465,18 @@ bool battery_widget::update(bool reset)
     if (!active)
         return false;
 
-    bool result;
-    std::string battery_string;
-
-    info->mutex.lock();
-
-    result = info->icon_updated[id] || info->percentage_updated[id];
-
-    battery_string = std::to_string(info->percentage) + "%";
-    info->mutex.unlock();
+    std::string battery_string = std::to_string(info->percentage) + "%";
+    bool result = battery_string != current_text || info->icon != current_icon;
 
     if (result || reset)
     {
-        cairo_set_font_size(cr, font_size * battery_options::text_scale);
-        cairo_set_font_face(cr, cairo_font_face);
+        current_text = battery_string;
 
-        cairo_text_extents_t te;
-        cairo_text_extents(cr, battery_string.c_str(), &te);
+        auto te = text_cache_extents(cairo_font_face,
+                font_size * battery_options::text_scale, current_text);
         width = font_size + 0.2 * font_size + te.width;
     }
 
-
     return result;
 }
 
@@ -475,43 +519,23 @@ void battery_widget::repaint()
     if (!active)
         return;
 
-    /* this is main thread, even if the dbus one has to wait, we
-     * don't care, as it isn't crucial for performance, so lock for more time in order
-     * to avoid constant lock()/unlock() calls */
-    info->mutex.lock();
+    current_icon = info->icon;
+    auto icon_surface = info->icon_surface;
 
-    if (info->icon_updated[id])
-    {
-        if (icon_surface)
-            cairo_surface_destroy(icon_surface);
-        icon_surface = nullptr;
-
-        if (info->icon != "none")
-            icon_surface = prepare_icon(info->icon);
-    }
-
-    std::string battery_string = std::to_string(info->percentage) + "%";
-
-    info->icon_updated[id] = info->percentage_updated[id] = false;
-    info->mutex.unlock();
-
-    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0); /* blank to white */
+    double text_size = font_size * battery_options::text_scale;
 
     cairo_identity_matrix(cr);
     cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
     int icon_size = font_size;
     cairo_new_path(cr);
 
-    cairo_text_extents_t te;
-    cairo_text_extents(cr, battery_string.c_str(), &te);
-
-    double sx = icon_size * 1.1, sy = (panel_h + te.height) / 2.0;
-    cairo_set_source_rgb(cr, 0.91, 0.918, 0.965);
+    auto te = text_cache_extents(cairo_font_face, text_size, current_text);
 
-    sx = x + font_size + 0.2 * font_size;
+    double sx = x + font_size + 0.2 * font_size;
+    double sy = (panel_h + te.height) / 2.0;
 
-    cairo_move_to(cr, sx, sy);
-    cairo_show_text(cr, battery_string.c_str());
+    cairo_set_source_rgb(cr, 0.91, 0.918, 0.965);
+    text_cache_show(cr, cairo_font_face, text_size, sx, sy, current_text);
 
     if (icon_surface)
     {
@@ -590,7 +614,7 @@ void launchers_widget::init_launchers(wayfire_config *config)
         launcher *l = new launcher;
         l->scale = default_launcher_scale;
 
-        l->img = cairo_try_load_png(icon.c_str());
+        l->img = load_cached_image(icon);
 
         if (!l->img)
         {
@@ -632,6 +656,9 @@ void launchers_widget::create()
             if (was_active != l->active)
                 need_repaint = true;
         }
+
+        if (need_repaint)
+            need_update();
     };
 
     pointer_button = [=] (uint32_t button, uint32_t state, int x, int y)
@@ -4,12 +4,28 @@
 #include <string>
 #include <cairo-ft.h>
 #include <functional>
-#include <thread>
+#include <map>
+#include <vector>
 #include "../shared/config.hpp"
 
 extern cairo_font_face_t *cairo_font_face;
 void load_default_font();
 
+/* the data behind a widget(time, battery, network state). There is one model
+ * per system source, shared by the widgets of all panels, which subscribe to
+ * it and are notified when it changes */
+struct widget_model
+{
+    std::map<int, std::function<void()>> listeners;
+
+    int subscribe(std::function<void()> callback);
+    void unsubscribe(int id);
+    void notify();
+};
+
+/* icons and images loaded from a file, each file is loaded only once */
+cairo_surface_t *load_cached_image(std::string path);
+
 struct widget
 {
     static wayfire_color background_color;
@@ -18,6 +34,9 @@ struct widget
 
     /* those are initialized before calling create() */
     cairo_t *cr;
+    /* widgets call this(from the main thread) when they have to be updated
+     * and repainted, the panel doesn't poll them */
+    std::function<void()> need_update;
     /* leftmost position in panel, panel height, maximum width */
     int x, panel_h, width = 0;
 
@@ -29,7 +48,7 @@ struct widget
      * in pixels right after create() has been called */
     virtual int get_width() = 0;
 
-    /* return true if widget has to be painted on this iter */
+    /* return true if widget has to be repainted, called after need_update() */
     virtual bool update(bool reset = false) = 0;
 
     virtual void repaint() = 0;
@@ -40,9 +59,15 @@ struct widget
     std::function<void(uint32_t, uint32_t, int, int)> pointer_button = nullptr;
 };
 
+struct clock_model;
 struct clock_widget : public widget
 {
     std::string current_text;
+    int id;
+
+    static clock_model *model;
+
+    ~clock_widget();
 
     void create();
     int get_width() { return width; };
@@ -66,11 +91,11 @@ struct battery_widget : public widget
     bool active = false;
     int id;
 
-    cairo_surface_t *icon_surface = nullptr;
+    /* what is currently displayed */
+    std::string current_text, current_icon;
 
     static battery_info *info;
     static upower_backend *backend;
-    static std::thread backend_thread;
 
     ~battery_widget();
 
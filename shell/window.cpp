@@ -203,7 +203,7 @@ void registry_add_object(void *data, struct wl_registry *registry, uint32_t name
     } else if (strcmp(interface, wl_shm_interface.name) == 0) {
         display.shm = (wl_shm*) wl_registry_bind(registry, name, &wl_shm_interface, std::min(version, 1u));
     } else if (strcmp(interface, wayfire_shell_interface.name) == 0) {
-        display.wfshell = (wayfire_shell*) wl_registry_bind(registry, name, &wayfire_shell_interface, std::min(version, 1u));
+        display.wfshell = (wayfire_shell*) wl_registry_bind(registry, name, &wayfire_shell_interface, std::min(version, 2u));
     } else if (strcmp(interface, wayfire_virtual_keyboard_interface.name) == 0) {
         display.vkbd = (wayfire_virtual_keyboard*) wl_registry_bind(registry, name, &wayfire_virtual_keyboard_interface, std::min(version, 1u));
     } else if (strcmp(interface, wl_output_interface.name) == 0)
@@ -69,5 +69,11 @@ wayfire_window* create_window(uint32_t width, uint32_t height);
 void set_active_window(wayfire_window* window);
 void backend_delete_window(wayfire_window* window);
 void damage_commit_window(wayfire_window *window);
+/* like damage_commit_window(), but only the given region(in buffer coordinates)
+ * has changed since the last commit */
+void damage_commit_window(wayfire_window *window, cairo_region_t *damage);
+/* false if the contents of the window are lost after a commit,
+ * so the whole window has to be redrawn each time */
+bool backend_preserves_contents();
 
 #endif /* end of include guard: COMMON_HPP */
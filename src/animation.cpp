@@ -0,0 +1,65 @@
+#include "animation.hpp"
+#include "output.hpp"
+#include "render-manager.hpp"
+#include <algorithm>
+#include <cmath>
+
+float wf_animation::linear(float x)
+{
+    return x;
+}
+
+float wf_animation::circle(float x)
+{
+    return std::sqrt(2 * x - x * x);
+}
+
+float wf_animation::ease_out(float x)
+{
+    x = 1 - x;
+    return 1 - x * x * x;
+}
+
+wf_duration::wf_duration(wayfire_output *output, int length_ms,
+        wf_animation::smooth_function smooth)
+{
+    this->output = output;
+    this->length = length_ms;
+    this->smooth = smooth;
+}
+
+void wf_duration::start()
+{
+    start_time = output->render->get_frame_time();
+    started = true;
+}
+
+float wf_duration::elapsed()
+{
+    if (!started || length <= 0)
+        return 1;
+
+    float x = 1.0 * (output->render->get_frame_time() - start_time) / length;
+    return std::max(0.0f, std::min(x, 1.0f));
+}
+
+float wf_duration::progress()
+{
+    return smooth(elapsed());
+}
+
+float wf_duration::progress(float start, float end)
+{
+    float p = progress();
+    return p * end + (1 - p) * start;
+}
+
+float wf_duration::progress(const wf_transition& transition)
+{
+    return progress(transition.start, transition.end);
+}
+
+bool wf_duration::running()
+{
+    return elapsed() < 1;
+}
@@ -0,0 +1,56 @@
+#ifndef ANIMATION_HPP
+#define ANIMATION_HPP
+
+#include <cstdint>
+
+class wayfire_output;
+
+namespace wf_animation
+{
+    /* easing curves, they map the elapsed part of the duration
+     * in [0, 1] to the progress of the animation in [0, 1] */
+    using smooth_function = float (*)(float);
+
+    float linear(float x);
+    /* fast at the start and slow at the end */
+    float circle(float x);
+    float ease_out(float x);
+}
+
+struct wf_transition
+{
+    float start, end;
+};
+
+/* A timeline for animations. It is sampled at the time when the frame which
+ * is currently painted will be shown(see render_manager::get_frame_time()),
+ * so animations take the same time regardless of the refresh rate, and
+ * they skip ahead instead of slowing down when frames are dropped */
+class wf_duration
+{
+    wayfire_output *output;
+    int length;
+    wf_animation::smooth_function smooth;
+
+    int64_t start_time = 0;
+    bool started = false;
+
+    float elapsed();
+
+    public:
+        wf_duration(wayfire_output *output = nullptr, int length_ms = 0,
+                wf_animation::smooth_function smooth = wf_animation::circle);
+
+        /* (re)start the timeline from the current frame */
+        void start();
+
+        /* the progress with the curve applied, 1 at and after the end */
+        float progress();
+        float progress(float start, float end);
+        float progress(const wf_transition& transition);
+
+        /* false once the current frame is at or after the end */
+        bool running();
+};
+
+#endif /* end of include guard: ANIMATION_HPP */
@@ -5,18 +5,22 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <string>
 
 #include <compositor.h>
 
 struct weston_desktop_surface;
 
 class input_manager;
+class wf_thread_pool;
 class wayfire_config;
 class wayfire_output;
 class wayfire_view_t;
 
 using wayfire_view = std::shared_ptr<wayfire_view_t>;
 using output_callback_proc = std::function<void(wayfire_output *)>;
+/* status is the one returned by waitpid() */
+using child_exit_callback = std::function<void(int status)>;
 
 class wayfire_core
 {
@@ -32,8 +36,10 @@ class wayfire_core
         std::map<weston_view *, wayfire_view> views;
 
         void configure(wayfire_config *config);
+        void init_launcher();
 
         int times_wake = 0;
+        wf_thread_pool *thread_pool = nullptr;
 
     public:
 
@@ -81,7 +87,20 @@ class wayfire_core
 
         void for_each_output(output_callback_proc);
 
-        void run(const char *command);
+        /* worker threads for CPU-heavy jobs, shared with the plugins */
+        wf_thread_pool& get_thread_pool();
+
+        /* runs command with /bin/sh without waiting for it. env has entries in
+         * the form NAME=value, which override the compositor's environment.
+         * Returns the pid of the shell or -1 on failure */
+        pid_t run(const char *command, const std::vector<std::string>& env = {});
+
+        /* callback is called when pid, a child of the compositor, exits.
+         * Children are reaped by the compositor, don't waitpid() for them */
+        void watch_child(pid_t pid, child_exit_callback callback);
+
+        /* used for the launch statistics, pid is the client which created a view */
+        void report_view_created(pid_t pid);
 
         int vwidth, vheight;
 
@@ -3,6 +3,8 @@
 
 #include "debug.hpp"
 #include <GLES2/gl2.h>
+#include <memory>
+#include <functional>
 
 #define ulong unsigned long
 
@@ -12,8 +14,32 @@ namespace image_io {
      * Returns -1 on failure */
     GLuint load_from_file(std::string name, ulong& x, ulong& y);
 
-    /* Function that saves the given pixels(in rgba format) to a (currently) png file */
-    void write_to_file(std::string name, uint8_t *pixels, int w, int h, std::string type);
+    /* Handle to a texture which is loaded in the background. The texture is
+     * shared between all handles to the same file and is deleted together
+     * with the last handle, so don't call glDeleteTextures() on it */
+    struct async_texture
+    {
+        GLuint tex = -1; /* stays -1 if loading failed */
+        ulong width = 0, height = 0;
+        bool ready = false;
+
+        std::string key;
+        ~async_texture();
+    };
+    using async_texture_ptr = std::shared_ptr<async_texture>;
+    using async_callback = std::function<void(async_texture_ptr)>;
+
+    /* Decodes the file in a worker thread, then uploads it on the compositor thread
+     * and calls callback. If the file is already cached, callback is called
+     * immediately. Returns nullptr if the file doesn't exist or has an unsupported type */
+    async_texture_ptr load_from_file_async(std::string name,
+                                           async_callback callback = nullptr);
+
+    /* Function that saves the given pixels(in rgba format, bottom-up rows as returned
+     * by glReadPixels) to a png, qoi or ppm file. fast trades file size for speed,
+     * for png this means a low compression level and multithreaded encoding */
+    void write_to_file(std::string name, uint8_t *pixels, int w, int h,
+                       std::string type, bool fast = false);
 
     /* Initializes all backends, called at startup */
     void init();
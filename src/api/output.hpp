@@ -53,6 +53,8 @@ class wayfire_output
     bool activate_plugin  (wayfire_grab_interface owner, bool lower_fs = true);
     bool deactivate_plugin(wayfire_grab_interface owner);
     bool is_plugin_active (owner_t owner_name);
+    /* true if a plugin other than owner is active on this output */
+    bool is_other_plugin_active(wayfire_grab_interface owner);
 
     void connect_signal(std::string name, signal_callback_t* callback);
     void disconnect_signal(std::string name, signal_callback_t* callback);
@@ -95,6 +95,12 @@ struct wayfire_grab_interface_t {
             std::function<void(weston_pointer*,weston_pointer_axis_event*)> axis;
             std::function<void(weston_pointer*,uint32_t, uint32_t)> button; // button, state
             std::function<void(weston_pointer*,weston_pointer_motion_event*)> motion;
+
+            /* opt-in, called at most once per frame of the grab's output, before
+             * the frame is painted(never during a repaint). ptr has the latest position,
+             * dx and dy are the movement since the last call. motion is still called
+             * for each event */
+            std::function<void(weston_pointer*, wl_fixed_t, wl_fixed_t)> frame_motion;
         } pointer;
 
         struct {
@@ -147,6 +153,4 @@ using render_hook_t = std::function<void()>;
 
 #define GetTuple(x,y,t) auto x = std::get<0>(t); \
                         auto y = std::get<1>(t)
-
-float GetProgress(float start, float end, float current_step, float max_steps);
 #endif
@@ -40,6 +40,8 @@ class render_manager
         bool draw_overlay_panel = true;
         pixman_region32_t frame_damage, single_pixel;
 
+        void render_builtin_background(pixman_region32_t *damage);
+
         int streams_running = 0;
 
         signal_callback_t view_moved_cb, viewport_changed_cb;
@@ -50,7 +52,7 @@ class render_manager
         void disable_full_damage_tracking();
         void get_ws_damage(std::tuple<int, int> ws, pixman_region32_t *out_damage);
 
-        std::vector<effect_hook_t*> output_effects;
+        std::vector<effect_hook_t*> output_effects, post_paint_hooks;
         int constant_redraw = 0;
         bool frame_was_custom_rendered = false, dirty_renderer = false;
         wl_event_source *idle_redraw_source = NULL, *full_repaint_source = NULL;
@@ -59,6 +61,12 @@ class render_manager
         bool paint(pixman_region32_t *damage);
         void post_paint();
 
+        /* latched at the start of each repaint, so that everything
+         * painted in one frame samples its animations at the same time */
+        int64_t frame_time = 0;
+        bool in_repaint = false;
+        int64_t predict_frame_time();
+
         void transformation_renderer();
         void run_effects();
         void render_panels();
@@ -79,9 +87,24 @@ class render_manager
         void schedule_redraw();
         void set_hide_overlay_panels(bool set);
 
+        /* the time(in ms, on the presentation clock) when the frame which is being
+         * painted will be shown, or outside of a repaint, when the next frame
+         * is going to be shown. Animations should be sampled at this time */
+        int64_t get_frame_time();
+
         void add_output_effect(effect_hook_t*, wayfire_view v = nullptr);
         void rem_effect(const effect_hook_t*, wayfire_view v = nullptr);
 
+        /* run when the frame is complete, after the effects and the panels,
+         * for ex. to read it back for a screenshot */
+        void add_post_paint_hook(effect_hook_t*);
+        void rem_post_paint_hook(const effect_hook_t*);
+
+        /* copies the region which changed in the last painted frame to out_damage,
+         * in output-local coordinates. Valid in output effects and post paint hooks,
+         * for ex. for screen recording */
+        void get_frame_damage(pixman_region32_t *out_damage);
+
         /* this function renders a viewport and
          * saves the image in texture which is returned */
         void texture_from_workspace(std::tuple<int, int>, uint& fbuff, uint &tex);
@@ -56,6 +56,12 @@ struct view_set_parent_signal : public signal_data
     wayfire_view view;
 };
 
+/* the title or the app-id of the view has changed */
+struct view_title_changed_signal : public signal_data
+{
+    wayfire_view view;
+};
+
 /* same as both change_viewport_request and change_viewport_notify */
 struct change_viewport_signal : public signal_data
 {
@@ -0,0 +1,40 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <functional>
+#include <memory>
+
+/* A pool of worker threads for short CPU jobs, shared by the compositor and
+ * the plugins(see wayfire_core::get_thread_pool()). The threads are started
+ * when the first job is submitted. Each worker has its own queue, idle workers
+ * steal jobs from the other queues.
+ *
+ * Jobs mustn't touch GL or the wayland objects, these belong to the
+ * compositor thread. Results can be passed back with an eventfd in the event loop */
+class wf_thread_pool
+{
+    struct impl;
+    std::unique_ptr<impl> priv;
+
+    public:
+        using task_t = std::function<void()>;
+        /* processes the elements in [start, end) */
+        using range_task_t = std::function<void(size_t start, size_t end)>;
+
+        wf_thread_pool();
+        ~wf_thread_pool();
+
+        /* the number of worker threads */
+        size_t size();
+
+        /* run task on one of the workers, doesn't wait for it */
+        void submit(task_t task);
+
+        /* Splits [begin, end) into chunks of at least min_chunk elements and
+         * calls task for them in parallel. The calling thread works on the chunks
+         * too, and the function returns when all of them are done */
+        void parallel_for(size_t begin, size_t end, size_t min_chunk,
+                const range_task_t& task);
+};
+
+#endif /* end of include guard: THREAD_POOL_HPP */
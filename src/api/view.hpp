@@ -49,16 +49,43 @@ using wayfire_view = std::shared_ptr<wayfire_view_t>;
 
 class wayfire_view_t
 {
-    /* a nasty hack, a better solution should be done in libweston */
-    wl_event_source *source_resize_plus = NULL;
-    wl_event_source *source_resize_minus = NULL;
-
-    friend void idle_resize_plus(void *data);
-    friend void idle_resize_minus(void *data);
+    wl_event_source *source_sync_position = NULL;
+    friend void idle_sync_xwayland_position(void *data);
 
     void force_update_xwayland_position();
     int in_continuous_move = 0, in_continuous_resize = 0;
 
+    /* During an interactive resize at most one configure is sent which the client
+     * hasn't answered yet. Newer geometries requested in the meantime replace
+     * each other and the last one is sent when the client commits */
+    struct {
+        bool waiting = false;
+        int sent_width, sent_height;
+        /* the committed size at the time the configure was sent */
+        int old_width, old_height;
+        int64_t sent_time;
+        wl_event_source *timeout = NULL;
+
+        bool has_pending = false;
+        weston_geometry pending;
+
+        /* statistics for the current resize, logged when it ends */
+        int sent = 0, coalesced = 0;
+        int64_t total_lag = 0, max_lag = 0;
+    } configure;
+
+    friend int configure_timeout(void *data);
+
+    /* libweston-desktop doesn't notify us about title changes,
+     * so they are checked for when the client commits */
+    std::string last_title, last_app_id;
+    void update_title(bool send_signal);
+
+    void configure_sent(int w, int h);
+    void configure_answered();
+    void log_configure_stats();
+    void check_configure_answered();
+
     public:
         weston_desktop_surface *desktop_surface;
 
@@ -54,6 +54,12 @@ class workspace_manager
 
         virtual wayfire_view get_background_view() = 0;
 
+        /* renders the built-in background(used when the shell doesn't provide a
+         * background view) to the currently bound framebuffer. damage is in
+         * output-local coordinates, nullptr means the whole output.
+         * Returns false if there is no built-in background */
+        virtual bool render_background(pixman_region32_t *damage, uint32_t bits) = 0;
+
         /* returns a list of all views on workspace that are visible on the current
          * workspace except panels(but should include background)
          * The list must be returned from top to bottom(i.e the last is background) */
@@ -75,6 +81,11 @@ class workspace_manager
                 uint32_t width, uint32_t height) = 0;
         virtual void configure_panel(wayfire_view view, int x, int y) = 0;
 
+        /* like configure_panel, but the panel slides from its current position
+         * to (x, y) in duration ms, curve is a wayfire_shell_panel_curve */
+        virtual void animate_panel(wayfire_view view, int x, int y,
+                uint32_t duration, uint32_t curve) = 0;
+
         /* returns the available area for views, it is basically
          * the output geometry minus the area reserved for panels */
         virtual weston_geometry get_workarea() = 0;
@@ -15,6 +15,7 @@
 #include "workspace-manager.hpp"
 #include "debug.hpp"
 #include "render-manager.hpp"
+#include "thread-pool.hpp"
 
 #if BUILD_WITH_IMAGEIO
 #include "img.hpp"
@@ -544,6 +545,17 @@ idle_finalize_grab(void *data)
     grab_start_finalized = true;
 }
 
+/* with the background drawn by the compositor there is no background view
+ * to give the pointer focus to during grabs, so we use a surface without a client */
+static weston_view *get_focus_park_view()
+{
+    static weston_view *view = nullptr;
+    if (!view)
+        view = weston_view_create(weston_surface_create(core->ec));
+
+    return view;
+}
+
 bool input_manager::grab_input(wayfire_grab_interface iface)
 {
     if (!iface || !iface->grabbed || !session_active)
@@ -557,13 +569,17 @@ bool input_manager::grab_input(wayfire_grab_interface iface)
 
     if (ptr)
     {
+        frame_motion.last_x = ptr->x;
+        frame_motion.last_y = ptr->y;
+        frame_motion.delivered = false;
+
         weston_pointer_start_grab(ptr, &pgrab);
+
+        /* the pointer focus is moved away from the clients while grabbed */
         auto background = core->get_active_output()->workspace->get_background_view();
-        if (background)
-        {
-            weston_pointer_clear_focus(ptr);
-            weston_pointer_set_focus(ptr, background->handle, -10000000, -1000000);
-        }
+        weston_pointer_clear_focus(ptr);
+        weston_pointer_set_focus(ptr, background ? background->handle : get_focus_park_view(),
+                -10000000, -1000000);
     }
 
     if (kbd)
@@ -585,6 +601,7 @@ bool input_manager::grab_input(wayfire_grab_interface iface)
 
 void input_manager::ungrab_input()
 {
+    cancel_frame_motion();
     active_grab = nullptr;
 
     auto ptr = weston_seat_get_pointer(core->get_current_seat());
@@ -648,12 +665,83 @@ void input_manager::propagate_pointer_grab_motion(
 {
     if (active_grab->callbacks.pointer.motion)
         active_grab->callbacks.pointer.motion(ptr, ev);
+
+    if (active_grab && active_grab->callbacks.pointer.frame_motion)
+        schedule_frame_motion(ptr);
+}
+
+void idle_flush_frame_motion(void *data)
+{
+    core->input->frame_motion.idle = NULL;
+    core->input->flush_frame_motion();
+}
+
+/* The motion is delivered at most once per frame of the grab's output, outside
+ * of the repaint, so that the views it moves are drawn in the next frame.
+ * The first motion after a frame is delivered from an idle callback, the rest
+ * waits until that frame has been painted */
+void input_manager::schedule_frame_motion(weston_pointer *ptr)
+{
+    frame_motion.ptr = ptr;
+    if (frame_motion.delivered)
+    {
+        /* make sure there is a frame after which it is delivered */
+        active_grab->output->render->schedule_redraw();
+        return;
+    }
+
+    if (!frame_motion.idle)
+    {
+        auto loop = wl_display_get_event_loop(core->ec->wl_display);
+        frame_motion.idle = wl_event_loop_add_idle(loop, idle_flush_frame_motion, nullptr);
+    }
+}
+
+void input_manager::cancel_frame_motion()
+{
+    if (frame_motion.idle)
+        wl_event_source_remove(frame_motion.idle);
+
+    frame_motion.idle = NULL;
+    frame_motion.ptr = nullptr;
+}
+
+void input_manager::output_frame_done(wayfire_output *output)
+{
+    if (!active_grab || active_grab->output != output)
+        return;
+
+    frame_motion.delivered = false;
+    if (frame_motion.ptr)
+        schedule_frame_motion(frame_motion.ptr);
+}
+
+void input_manager::flush_frame_motion()
+{
+    auto ptr = frame_motion.ptr;
+    cancel_frame_motion();
+
+    if (!ptr || !active_grab || !active_grab->callbacks.pointer.frame_motion)
+        return;
+
+    frame_motion.delivered = true;
+    wl_fixed_t dx = ptr->x - frame_motion.last_x;
+    wl_fixed_t dy = ptr->y - frame_motion.last_y;
+    frame_motion.last_x = ptr->x;
+    frame_motion.last_y = ptr->y;
+
+    active_grab->callbacks.pointer.frame_motion(ptr, dx, dy);
 }
 
 void input_manager::propagate_pointer_grab_button(weston_pointer *ptr,
         uint32_t button,
         uint32_t state)
 {
+    /* the plugin should see the position at which the button was pressed */
+    flush_frame_motion();
+    if (!active_grab)
+        return;
+
     if (active_grab->callbacks.pointer.button)
         active_grab->callbacks.pointer.button(ptr, button, state);
 }
@@ -949,7 +1037,8 @@ void unbind_desktop_shell(wl_resource *resource)
 
 void bind_desktop_shell(wl_client *client, void *data, uint32_t version, uint32_t id)
 {
-    auto resource = wl_resource_create(client, &wayfire_shell_interface, 1, id);
+    auto resource = wl_resource_create(client, &wayfire_shell_interface,
+            std::min(version, 2u), id);
     wl_resource_set_implementation(resource, &shell_interface_impl,
             NULL, unbind_desktop_shell);
 
@@ -961,13 +1050,14 @@ void wayfire_core::init(weston_compositor *comp, wayfire_config *conf)
 {
     ec = comp;
     configure(conf);
+    init_launcher();
 
 #if BUILD_WITH_IMAGEIO
     image_io::init();
 #endif
 
     if (wl_global_create(ec->wl_display, &wayfire_shell_interface,
-                1, NULL, bind_desktop_shell) == NULL) {
+                2, NULL, bind_desktop_shell) == NULL) {
         errio << "Failed to create wayfire_shell interface" << std::endl;
     }
 }
@@ -1316,23 +1406,12 @@ void wayfire_core::erase_view(wayfire_view v, bool destroy_handle)
         weston_view_destroy(v->handle);
 }
 
-void wayfire_core::run(const char *command)
+wf_thread_pool& wayfire_core::get_thread_pool()
 {
-    pid_t pid = fork();
+    if (!thread_pool)
+        thread_pool = new wf_thread_pool();
 
-    /* The following is a "hack" for disowning the child processes,
-     * otherwise they will simply stay as zombie processes */
-    if (!pid) {
-        if (!fork()) {
-            setenv("WAYLAND_DISPLAY", wayland_display.c_str(), 1);
-            exit(execl("/bin/sh", "/bin/bash", "-c", command, NULL));
-        } else {
-            exit(0);
-        }
-    } else {
-        int status;
-        waitpid(pid, &status, 0);
-    }
+    return *thread_pool;
 }
 
 void wayfire_core::move_view_to_output(wayfire_view v, wayfire_output *new_output)
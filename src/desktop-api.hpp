@@ -11,11 +11,18 @@
 #include "workspace-manager.hpp"
 #include "signal-definitions.hpp"
 #include "view.hpp"
+#include "xwayland.hpp"
 
 void desktop_surface_added(weston_desktop_surface *desktop_surface, void *shell)
 {
     debug << "desktop_surface_added " << desktop_surface << std::endl;
     core->add_view(desktop_surface);
+    xwayland_view_added(core->find_view(desktop_surface));
+
+    pid_t pid;
+    auto surface = weston_desktop_surface_get_surface(desktop_surface);
+    wl_client_get_credentials(wl_resource_get_client(surface->resource), &pid, NULL, NULL);
+    core->report_view_created(pid);
 }
 
 void desktop_surface_removed(weston_desktop_surface *surface, void *user_data)
@@ -31,6 +38,7 @@ void desktop_surface_removed(weston_desktop_surface *surface, void *user_data)
     pixman_region32_init(&view->surface->input);
 
     view->destroyed = true;
+    xwayland_view_removed(view);
 
     if (view->output)
     {
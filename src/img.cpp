@@ -1,59 +1,81 @@
 #include "img.hpp"
 #include "opengl.hpp"
 #include "debug.hpp"
+#include "core.hpp"
+#include "thread-pool.hpp"
 
 #include <png.h>
+#include <zlib.h>
 #include <stdint.h>
 #include <jpeglib.h>
 #include <jerror.h>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <algorithm>
 #include <unordered_map>
 #include <functional>
+#include <vector>
+#include <mutex>
+#include <queue>
 
-#define TEXTURE_LOAD_ERROR 0
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 
 namespace image_io {
-    using Loader = std::function<GLuint(const char *, ulong&, ulong&)>;
-    using Writer = std::function<void(const char *name, uint8_t *pixels, ulong, ulong)>;
+    /* decoded pixels, ready for glTexImage2D() */
+    struct decoded_image
+    {
+        ulong width = 0, height = 0;
+        GLenum format = GL_RGBA;
+        std::vector<uint8_t> data;
+    };
+
+    using Decoder = std::function<bool(const char *, decoded_image&)>;
+    using Writer = std::function<void(const char *name, uint8_t *pixels, ulong, ulong, bool)>;
     namespace {
-        std::unordered_map<std::string, Loader> loaders;
+        std::unordered_map<std::string, Decoder> decoders;
         std::unordered_map<std::string, Writer> writers;
     }
 
     /* All backend functions are taken from the internet.
      * If you want to be credited, contact me */
 
-    GLuint texture_from_png(const char *filename, ulong& w, ulong& h)
+    bool decode_png(const char *filename, decoded_image& image)
     {
         FILE *fp = fopen(filename, "rb");
-        int width, height;
-        png_byte color_type;
-        png_byte bit_depth;
-        png_bytep *row_pointers;
-
+        if (!fp) {
+            errio << "Error reading PNG file " << filename << std::endl;
+            return false;
+        }
 
         png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        if(!png)
-            return TEXTURE_LOAD_ERROR;;
+        if(!png) {
+            fclose(fp);
+            return false;
+        }
 
         png_infop infos = png_create_info_struct(png);
-        if(!infos)
-            return TEXTURE_LOAD_ERROR;
+        if(!infos) {
+            png_destroy_read_struct(&png, NULL, NULL);
+            fclose(fp);
+            return false;
+        }
 
-        if(setjmp(png_jmpbuf(png)))
-            return TEXTURE_LOAD_ERROR;
+        if(setjmp(png_jmpbuf(png))) {
+            png_destroy_read_struct(&png, &infos, NULL);
+            fclose(fp);
+            return false;
+        }
 
         png_init_io(png, fp);
         png_read_info(png, infos);
 
-        width      = png_get_image_width(png, infos);
-        height     = png_get_image_height(png, infos);
-        color_type = png_get_color_type(png, infos);
-        bit_depth  = png_get_bit_depth(png, infos);
-
-        w = width;
-        h = height;
+        int width             = png_get_image_width(png, infos);
+        int height            = png_get_image_height(png, infos);
+        png_byte color_type   = png_get_color_type(png, infos);
+        png_byte bit_depth    = png_get_bit_depth(png, infos);
 
         // Read any color_type into 8bit depth, RGBA format.
         // See http://www.libpng.org/pub/png/libpng-manual.txt
@@ -83,29 +105,27 @@ namespace image_io {
 
         png_read_update_info(png, infos);
 
-        row_pointers = new png_bytep[height];
-        png_byte *data = new png_byte[height * png_get_rowbytes(png, infos)];
+        auto rowbytes = png_get_rowbytes(png, infos);
+        image.width = width;
+        image.height = height;
+        image.format = GL_RGBA;
+        image.data.resize(height * rowbytes);
 
+        std::vector<png_bytep> row_pointers(height);
         for(int i = 0; i < height; i++)
-        {
-            row_pointers[i] = data + i * png_get_rowbytes(png, infos);
-        }
-
-        png_read_image(png, row_pointers);
-
-        GLuint texture;
-        GL_CALL(glGenTextures(1, &texture));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
-
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                             GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid *) data));
+            row_pointers[i] = image.data.data() + i * rowbytes;
 
+        png_read_image(png, row_pointers.data());
         png_destroy_read_struct(&png, &infos, NULL);
-        delete[] row_pointers;
-
         fclose(fp);
 
-        return texture;
+        return true;
+    }
+
+    /* pixels passed to the writers come from glReadPixels(), so the rows are bottom-up */
+    static inline uint8_t *get_row(uint8_t *pixels, int w, int h, int row)
+    {
+        return pixels + (h - 1 - row) * w * 4;
     }
 
     void texture_to_png(const char *name, uint8_t *pixels, int w, int h)
@@ -129,111 +149,620 @@ namespace image_io {
         png_init_io(png, fp);
         png_set_IHDR(png, infot, w, h, 8 /* depth */, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
                      PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-        png_colorp palette = (png_colorp)png_malloc(png, PNG_MAX_PALETTE_LENGTH * sizeof(png_color));
-        if (!palette) {
-            fclose(fp);
-            png_destroy_write_struct(&png, &infot);
-            return;
-        }
-        png_set_PLTE(png, infot, palette, PNG_MAX_PALETTE_LENGTH);
         png_write_info(png, infot);
-        png_set_packing(png);
 
-        png_bytepp rows = (png_bytepp)png_malloc(png, h * sizeof(png_bytep));
+        std::vector<png_bytep> rows(h);
         for (int i = 0; i < h; ++i)
-            rows[i] = (png_bytep)(pixels + (h - i) * w * 4);
+            rows[i] = get_row(pixels, w, h, i);
 
-        png_write_image(png, rows);
+        png_write_image(png, rows.data());
         png_write_end(png, infot);
-        png_free(png, palette);
         png_destroy_write_struct(&png, &infot);
 
         fclose(fp);
-        delete[] rows;
     }
 
-    GLuint texture_from_jpeg(const char *FileName, unsigned long& x, unsigned long& y)
+    /* Fast PNG writer: rows are split in stripes which are filtered(with the cheap
+     * "sub" filter) and deflated in parallel at a low compression level, in the same
+     * way pigz does it. Every stripe ends on a byte boundary(Z_SYNC_FLUSH), so the
+     * compressed stripes can be simply concatenated into one zlib stream */
+    namespace
+    {
+        struct png_stripe
+        {
+            int start, end;
+            std::vector<uint8_t> out;
+            uLong adler;
+            bool last;
+        };
+
+        void compress_png_stripe(png_stripe *stripe, uint8_t *pixels, int w, int h)
+        {
+            const size_t row_len = 1 + w * 4;
+            std::vector<uint8_t> filtered(row_len * (stripe->end - stripe->start));
+
+            uint8_t *out = filtered.data();
+            for (int j = stripe->start; j < stripe->end; j++)
+            {
+                uint8_t *row = get_row(pixels, w, h, j);
+
+                *out++ = 1; /* PNG_FILTER_VALUE_SUB */
+                for (int i = 0; i < 4; i++)
+                    *out++ = row[i];
+                for (int i = 4; i < w * 4; i++)
+                    *out++ = row[i] - row[i - 4];
+            }
+
+            stripe->adler = adler32(adler32(0, NULL, 0), filtered.data(), filtered.size());
+
+            z_stream zs;
+            zs.zalloc = Z_NULL;
+            zs.zfree = Z_NULL;
+            zs.opaque = Z_NULL;
+            /* negative window bits - raw deflate, header and checksum are written by us */
+            deflateInit2(&zs, 1, Z_DEFLATED, -15, 8, Z_RLE);
+
+            stripe->out.resize(deflateBound(&zs, filtered.size()) + 16);
+            zs.next_in = filtered.data();
+            zs.avail_in = filtered.size();
+            zs.next_out = stripe->out.data();
+            zs.avail_out = stripe->out.size();
+
+            deflate(&zs, stripe->last ? Z_FINISH : Z_SYNC_FLUSH);
+            stripe->out.resize(stripe->out.size() - zs.avail_out);
+            deflateEnd(&zs);
+        }
+
+        void put_u32_be(std::vector<uint8_t>& v, uint32_t x)
+        {
+            v.push_back(x >> 24);
+            v.push_back(x >> 16);
+            v.push_back(x >> 8);
+            v.push_back(x);
+        }
+
+        void write_png_chunk(FILE *fp, const char *type, const std::vector<uint8_t>& data)
+        {
+            std::vector<uint8_t> head;
+            put_u32_be(head, data.size());
+            head.insert(head.end(), type, type + 4);
+
+            uLong crc = crc32(0, (const Bytef*) type, 4);
+            crc = crc32(crc, data.data(), data.size());
+
+            std::vector<uint8_t> tail;
+            put_u32_be(tail, crc);
+
+            fwrite(head.data(), 1, head.size(), fp);
+            fwrite(data.data(), 1, data.size(), fp);
+            fwrite(tail.data(), 1, tail.size(), fp);
+        }
+    }
+
+    void texture_to_png_fast(const char *name, uint8_t *pixels, int w, int h)
+    {
+        FILE *fp = fopen(name, "wb");
+        if (!fp) {
+            errio << "IMG: failed to open " << name << std::endl;
+            return;
+        }
+
+        const int min_stripe_rows = 64;
+        int nthreads = core->get_thread_pool().size() + 1;
+        int nstripes = std::max(1, std::min(nthreads, h / min_stripe_rows));
+
+        std::vector<png_stripe> stripes(nstripes);
+        for (int i = 0; i < nstripes; i++)
+        {
+            stripes[i].start = h * i / nstripes;
+            stripes[i].end = h * (i + 1) / nstripes;
+            stripes[i].last = (i == nstripes - 1);
+        }
+
+        core->get_thread_pool().parallel_for(0, nstripes, 1,
+            [&] (size_t start, size_t end)
+            {
+                for (size_t i = start; i < end; i++)
+                    compress_png_stripe(&stripes[i], pixels, w, h);
+            });
+
+        const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        fwrite(signature, 1, sizeof(signature), fp);
+
+        std::vector<uint8_t> ihdr;
+        put_u32_be(ihdr, w);
+        put_u32_be(ihdr, h);
+        ihdr.insert(ihdr.end(), {8 /* depth */, 6 /* RGBA */, 0, 0, 0});
+        write_png_chunk(fp, "IHDR", ihdr);
+
+        std::vector<uint8_t> idat = {0x78, 0x01}; /* zlib header, fastest level */
+        uLong adler = adler32(0, NULL, 0);
+        for (auto& stripe : stripes)
+        {
+            idat.insert(idat.end(), stripe.out.begin(), stripe.out.end());
+            adler = adler32_combine(adler, stripe.adler,
+                                    (stripe.end - stripe.start) * (1 + w * 4));
+        }
+        put_u32_be(idat, adler);
+        write_png_chunk(fp, "IDAT", idat);
+
+        write_png_chunk(fp, "IEND", {});
+        fclose(fp);
+    }
+
+    /* QOI, see https://qoiformat.org/qoi-specification.pdf
+     * Encodes much faster than PNG with comparable sizes for screen contents */
+    void texture_to_qoi(const char *name, uint8_t *pixels, int w, int h)
+    {
+        FILE *fp = fopen(name, "wb");
+        if (!fp) {
+            errio << "IMG: failed to open " << name << std::endl;
+            return;
+        }
+
+        std::vector<uint8_t> out = {'q', 'o', 'i', 'f'};
+        out.reserve(w * h * 2);
+        put_u32_be(out, w);
+        put_u32_be(out, h);
+        out.push_back(4); /* channels */
+        out.push_back(0); /* sRGB with linear alpha */
+
+        uint32_t index[64] = {0};
+        uint8_t prev[4] = {0, 0, 0, 255};
+        int run = 0;
+
+        for (int j = 0; j < h; j++)
+        {
+            uint8_t *row = get_row(pixels, w, h, j);
+            for (int i = 0; i < w; i++)
+            {
+                uint8_t *px = row + 4 * i;
+                bool last_pixel = (j == h - 1 && i == w - 1);
+
+                if (!memcmp(px, prev, 4))
+                {
+                    ++run;
+                    if (run == 62 || last_pixel)
+                    {
+                        out.push_back(0xc0 | (run - 1));
+                        run = 0;
+                    }
+
+                    continue;
+                }
+
+                if (run > 0)
+                {
+                    out.push_back(0xc0 | (run - 1));
+                    run = 0;
+                }
+
+                uint32_t value;
+                memcpy(&value, px, 4);
+                int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+
+                if (index[hash] == value)
+                {
+                    out.push_back(hash);
+                } else
+                {
+                    index[hash] = value;
+                    if (px[3] == prev[3])
+                    {
+                        int8_t vr = px[0] - prev[0];
+                        int8_t vg = px[1] - prev[1];
+                        int8_t vb = px[2] - prev[2];
+                        int8_t vg_r = vr - vg;
+                        int8_t vg_b = vb - vg;
+
+                        if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                        {
+                            out.push_back(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                        } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                                   vg_b > -9 && vg_b < 8)
+                        {
+                            out.push_back(0x80 | (vg + 32));
+                            out.push_back((vg_r + 8) << 4 | (vg_b + 8));
+                        } else
+                        {
+                            out.insert(out.end(), {0xfe, px[0], px[1], px[2]});
+                        }
+                    } else
+                    {
+                        out.insert(out.end(), {0xff, px[0], px[1], px[2], px[3]});
+                    }
+                }
+
+                memcpy(prev, px, 4);
+            }
+        }
+
+        out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+        fwrite(out.data(), 1, out.size(), fp);
+        fclose(fp);
+    }
+
+    /* binary PPM, no compression at all, alpha is dropped */
+    void texture_to_ppm(const char *name, uint8_t *pixels, int w, int h)
+    {
+        FILE *fp = fopen(name, "wb");
+        if (!fp) {
+            errio << "IMG: failed to open " << name << std::endl;
+            return;
+        }
+
+        fprintf(fp, "P6\n%d %d\n255\n", w, h);
+
+        std::vector<uint8_t> line(w * 3);
+        for (int j = 0; j < h; j++)
+        {
+            uint8_t *row = get_row(pixels, w, h, j);
+            for (int i = 0; i < w; i++)
+            {
+                line[3 * i + 0] = row[4 * i + 0];
+                line[3 * i + 1] = row[4 * i + 1];
+                line[3 * i + 2] = row[4 * i + 2];
+            }
+
+            fwrite(line.data(), 1, line.size(), fp);
+        }
+
+        fclose(fp);
+    }
+
+    bool decode_jpeg(const char *filename, decoded_image& image)
     {
-        unsigned int texture_id;
-        unsigned long data_size;
-        int channels;
         unsigned char *rowptr[1];
-        unsigned char *jdata;
         struct jpeg_decompress_struct infot;
         struct jpeg_error_mgr err;
 
-        std::FILE *file = fopen(FileName, "rb");
-        infot.err = jpeg_std_error(& err);
-        jpeg_create_decompress(&infot);
-
+        std::FILE *file = fopen(filename, "rb");
         if(!file) {
-            errio << "Error reading JPEG file" << FileName << std::endl;
-            return 0;
+            errio << "Error reading JPEG file " << filename << std::endl;
+            return false;
         }
 
+        infot.err = jpeg_std_error(& err);
+        jpeg_create_decompress(&infot);
+
         jpeg_stdio_src(&infot, file);
         jpeg_read_header(&infot, TRUE);
+
+        /* we always upload GL_RGB */
+        infot.out_color_space = JCS_RGB;
         jpeg_start_decompress(&infot);
 
-        x = infot.output_width;
-        y = infot.output_height;
-        channels = infot.num_components;
-        data_size = x * y * 3;
+        image.width = infot.output_width;
+        image.height = infot.output_height;
+        image.format = GL_RGB;
+        image.data.resize(image.width * image.height * 3);
 
-        jdata = new unsigned char[data_size];
         while (infot.output_scanline < infot.output_height) {
-            rowptr[0] = (unsigned char *)jdata +  3* infot.output_width * infot.output_scanline;
+            rowptr[0] = image.data.data() + 3 * infot.output_width * infot.output_scanline;
             jpeg_read_scanlines(&infot, rowptr, 1);
         }
 
         jpeg_finish_decompress(&infot);
+        jpeg_destroy_decompress(&infot);
+        fclose(file);
 
-        GL_CALL(glGenTextures(1,&texture_id));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, texture_id));
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y, 0, GL_RGB, GL_UNSIGNED_BYTE, jdata));
+        return true;
+    }
 
-        fclose(file);
-        delete[] jdata;
-        return texture_id;
+    /* with use_pbo, the pixels are first copied to a pixel unpack buffer, so that
+     * the driver can do the actual transfer asynchronously */
+    GLuint upload_texture(const decoded_image& image, bool use_pbo)
+    {
+        GLuint texture, pbo = 0;
+        GL_CALL(glGenTextures(1, &texture));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+
+        const void *src = image.data.data();
+        if (use_pbo)
+        {
+            GL_CALL(glGenBuffers(1, &pbo));
+            GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo));
+            GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, image.data.size(), NULL, GL_STREAM_DRAW));
+
+            void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.data.size(),
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (dst)
+            {
+                memcpy(dst, src, image.data.size());
+                GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+                src = NULL; /* offset 0 in the buffer */
+            } else
+            {
+                GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            }
+        }
+
+        /* RGB rows aren't necessarily 4-byte aligned */
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, image.format, image.width, image.height, 0,
+                             image.format, GL_UNSIGNED_BYTE, src));
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+        if (pbo)
+        {
+            GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            GL_CALL(glDeleteBuffers(1, &pbo));
+        }
+
+        return texture;
     }
 
-    GLuint load_from_file(std::string name, ulong& w, ulong& h)
+    static Decoder* find_decoder(const std::string& name)
     {
         int len = name.length();
         if (len < 4 || name[len - 4] != '.') {
             errio << "load_from_file() called with file without extension or with invalid extension!\n";
-            return -1;
+            return nullptr;
         }
 
         auto ext = name.substr(len - 3, 3);
         for (int i = 0; i < 3; i++)
             ext[i] = std::tolower(ext[i]);
 
-        auto it = loaders.find(ext);
-        if (it == loaders.end()) {
+        auto it = decoders.find(ext);
+        if (it == decoders.end()) {
             errio << "load_from_file() called with unsupported extension " << ext << std::endl;
+            return nullptr;
+        }
+
+        return &it->second;
+    }
+
+    GLuint load_from_file(std::string name, ulong& w, ulong& h)
+    {
+        auto decoder = find_decoder(name);
+        decoded_image image;
+
+        if (!decoder || !(*decoder)(name.c_str(), image))
             return -1;
-        } else {
-            return it->second(name.c_str(), w, h);
+
+        w = image.width;
+        h = image.height;
+        return upload_texture(image, false);
+    }
+
+    /* Asynchronous loading: images are decoded in the thread pool, the workers
+     * signal the compositor thread through an eventfd when they are done. The
+     * texture is then uploaded and shared by all handles of the same file
+     * (with the same modification time) until the last of them is destroyed */
+    namespace
+    {
+        struct cache_entry
+        {
+            GLuint tex = -1;
+            ulong width = 0, height = 0;
+            int refcount = 0;
+            bool ready = false;
+
+            using waiting_t = std::pair<std::weak_ptr<async_texture>, async_callback>;
+            std::vector<waiting_t> waiting;
+        };
+        std::unordered_map<std::string, cache_entry> cache;
+
+        struct decode_job
+        {
+            std::string key, path;
+            decoded_image image;
+            bool ok = false;
+        };
+
+        std::mutex jobs_lock;
+        std::queue<decode_job> finished_jobs;
+        int notify_fd = -1;
+
+        /* runs in the thread pool */
+        void decode(decode_job job)
+        {
+            auto decoder = find_decoder(job.path);
+            job.ok = decoder && (*decoder)(job.path.c_str(), job.image);
+
+            jobs_lock.lock();
+            finished_jobs.push(std::move(job));
+            jobs_lock.unlock();
+
+            uint64_t one = 1;
+            if (write(notify_fd, &one, sizeof(one)) < 0)
+                errio << "IMG: failed to notify compositor thread" << std::endl;
         }
+
+        void finish_entry(cache_entry& entry)
+        {
+            auto waiting = std::move(entry.waiting);
+            entry.waiting.clear();
+
+            for (auto& w : waiting)
+            {
+                auto handle = w.first.lock();
+                if (!handle)
+                    continue;
+
+                /* failed loads aren't cached, so the handle doesn't reference the entry */
+                if (entry.tex == (GLuint)-1)
+                    handle->key.clear();
+
+                handle->tex = entry.tex;
+                handle->width = entry.width;
+                handle->height = entry.height;
+                handle->ready = true;
+
+                if (w.second)
+                    w.second(handle);
+            }
+        }
+
+        int handle_finished_jobs(int fd, uint32_t mask, void *data)
+        {
+            uint64_t count;
+            if (read(fd, &count, sizeof(count)) < 0)
+                return 0;
+
+            std::queue<decode_job> finished;
+            jobs_lock.lock();
+            std::swap(finished, finished_jobs);
+            jobs_lock.unlock();
+
+            while (!finished.empty())
+            {
+                auto& job = finished.front();
+                auto it = cache.find(job.key);
+
+                /* all handles were dropped while decoding */
+                if (it != cache.end() && it->second.refcount == 0)
+                {
+                    cache.erase(it);
+                } else if (it != cache.end())
+                {
+                    auto& entry = it->second;
+                    if (job.ok)
+                    {
+                        entry.width = job.image.width;
+                        entry.height = job.image.height;
+                        entry.tex = upload_texture(job.image, true);
+                    }
+
+                    entry.ready = true;
+                    finish_entry(entry);
+
+                    /* handles to failed loads keep tex == -1, don't cache the failure */
+                    if (!job.ok)
+                        cache.erase(job.key);
+                }
+
+                finished.pop();
+            }
+
+            return 0;
+        }
+
+        bool start_decoder()
+        {
+            if (notify_fd >= 0)
+                return true;
+
+            notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (notify_fd < 0)
+            {
+                errio << "IMG: failed to create eventfd, async loading disabled" << std::endl;
+                return false;
+            }
+
+            auto loop = wl_display_get_event_loop(core->ec->wl_display);
+            wl_event_loop_add_fd(loop, notify_fd, WL_EVENT_READABLE,
+                                 handle_finished_jobs, NULL);
+
+            return true;
+        }
+    }
+
+    async_texture::~async_texture()
+    {
+        /* loaded synchronously, not in the cache */
+        if (key.empty())
+        {
+            if (tex != (GLuint)-1)
+            {
+                GL_CALL(glDeleteTextures(1, &tex));
+            }
+            return;
+        }
+
+        auto it = cache.find(key);
+        if (it == cache.end())
+            return;
+
+        if (--it->second.refcount > 0 || !it->second.ready)
+            return;
+
+        if (it->second.tex != (GLuint)-1)
+        {
+            GL_CALL(glDeleteTextures(1, &it->second.tex));
+        }
+        cache.erase(it);
+    }
+
+    async_texture_ptr load_from_file_async(std::string name, async_callback callback)
+    {
+        struct stat st;
+        if (stat(name.c_str(), &st) != 0)
+        {
+            errio << "IMG: cannot open " << name << std::endl;
+            return nullptr;
+        }
+
+        if (!find_decoder(name))
+            return nullptr;
+
+        auto handle = std::make_shared<async_texture>();
+        handle->key = name + ":" + std::to_string(st.st_mtime);
+
+        auto it = cache.find(handle->key);
+        if (it == cache.end())
+        {
+            if (!start_decoder())
+            {
+                /* fall back to synchronous loading */
+                handle->tex = load_from_file(name, handle->width, handle->height);
+                handle->ready = true;
+                handle->key.clear();
+
+                if (callback)
+                    callback(handle);
+                return handle;
+            }
+
+            it = cache.insert({handle->key, cache_entry()}).first;
+
+            decode_job job;
+            job.key = handle->key;
+            job.path = name;
+
+            core->get_thread_pool().submit(std::bind(decode, std::move(job)));
+        }
+
+        auto& entry = it->second;
+        ++entry.refcount;
+
+        entry.waiting.push_back({handle, callback});
+        if (entry.ready)
+            finish_entry(entry);
+
+        return handle;
     }
 
-    void write_to_file(std::string name, uint8_t *pixels, int w, int h, std::string type)
+    void write_to_file(std::string name, uint8_t *pixels, int w, int h,
+                       std::string type, bool fast)
     {
         auto it = writers.find(type);
 
         if (it == writers.end()) {
             errio << "IMG: unsupported writer backend" << std::endl;
         } else {
-            it->second(name.c_str(), pixels, w, h);
+            it->second(name.c_str(), pixels, w, h, fast);
         }
     }
 
     void init()
     {
         debug << "ImageIO init" << std::endl;
-        loaders["png"] = Loader(texture_from_png);
-        loaders["jpg"] = Loader(texture_from_jpeg);
-        writers["png"] = Writer(texture_to_png);
+        decoders["png"] = Decoder(decode_png);
+        decoders["jpg"] = Decoder(decode_jpeg);
+        writers["png"] = [] (const char *name, uint8_t *pixels, ulong w, ulong h, bool fast)
+        {
+            if (fast)
+                texture_to_png_fast(name, pixels, w, h);
+            else
+                texture_to_png(name, pixels, w, h);
+        };
+
+        /* these are fast anyway */
+        writers["qoi"] = [] (const char *name, uint8_t *pixels, ulong w, ulong h, bool)
+        { texture_to_qoi(name, pixels, w, h); };
+        writers["ppm"] = [] (const char *name, uint8_t *pixels, ulong w, ulong h, bool)
+        { texture_to_ppm(name, pixels, w, h); };
     }
 }
@@ -44,6 +44,18 @@ class input_manager
         };
         std::map<int, touch_listener> touch_listeners;
 
+        /* see callbacks.pointer.frame_motion in wayfire_grab_interface_t */
+        struct {
+            weston_pointer *ptr = nullptr;
+            wl_fixed_t last_x, last_y;
+            wl_event_source *idle = NULL;
+            /* motion was already delivered for the frame being built */
+            bool delivered = false;
+        } frame_motion;
+        void schedule_frame_motion(weston_pointer *ptr);
+        void cancel_frame_motion();
+        friend void idle_flush_frame_motion(void *data);
+
         std::vector<key_callback_data*> key_pool;
         std::vector<button_callback_data*> button_pool;
         bool is_touch_enabled();
@@ -61,6 +73,10 @@ class input_manager
         void propagate_pointer_grab_axis  (weston_pointer *ptr, weston_pointer_axis_event *ev);
         void propagate_pointer_grab_motion(weston_pointer *ptr, weston_pointer_motion_event *ev);
         void propagate_pointer_grab_button(weston_pointer *ptr, uint32_t button, uint32_t state);
+        /* send the coalesced motion now, if there is any */
+        void flush_frame_motion();
+        /* called by the render_manager when it has painted a frame */
+        void output_frame_done(wayfire_output *output);
 
         void propagate_keyboard_grab_key(weston_keyboard *kdb, uint32_t key, uint32_t state);
         void propagate_keyboard_grab_mod(weston_keyboard *kbd, uint32_t depressed,
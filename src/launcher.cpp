@@ -0,0 +1,171 @@
+#include "core.hpp"
+#include "debug.hpp"
+#include "../shared/config.hpp"
+
+#include <wayland-server.h>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/* Commands are started with posix_spawn(), which glibc implements with
+ * vfork semantics, so the page tables of the compositor aren't copied.
+ * Exited children are reaped from a signalfd in the event loop, so the
+ * compositor never blocks in waitpid() */
+
+using launch_clock = std::chrono::steady_clock;
+
+struct wf_child
+{
+    child_exit_callback callback;
+
+    /* empty for children which weren't started by run() */
+    std::string command;
+    launch_clock::time_point start;
+    bool view_reported = false;
+};
+
+static std::map<pid_t, wf_child> children;
+static wl_event_source *sigchld_source = NULL;
+static bool log_launch_stats = false;
+
+static int64_t msec_since(launch_clock::time_point start)
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(launch_clock::now() - start).count();
+}
+
+static int handle_sigchld(int, void*)
+{
+    int status;
+    pid_t pid;
+
+    /* signals are coalesced, so reap everything which has exited */
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        auto it = children.find(pid);
+        if (it == children.end())
+            continue;
+
+        auto child = std::move(it->second);
+        children.erase(it);
+
+        if (log_launch_stats && !child.command.empty())
+        {
+            info << "launcher: \"" << child.command << "\" (" << pid << ") exited with "
+                << status << " after " << msec_since(child.start) << "ms" << std::endl;
+        }
+
+        if (child.callback)
+            child.callback(status);
+    }
+
+    return 0;
+}
+
+void wayfire_core::init_launcher()
+{
+    log_launch_stats = config->get_section("core")->get_int("launch_stats", 0);
+
+    auto loop = wl_display_get_event_loop(ec->wl_display);
+    sigchld_source = wl_event_loop_add_signal(loop, SIGCHLD, handle_sigchld, NULL);
+    if (!sigchld_source)
+        errio << "launcher: failed to watch SIGCHLD, children won't be reaped" << std::endl;
+}
+
+void wayfire_core::watch_child(pid_t pid, child_exit_callback callback)
+{
+    auto& child = children[pid];
+    child.callback = callback;
+    child.start = launch_clock::now();
+}
+
+/* the environment of the compositor with WAYLAND_DISPLAY and env applied */
+static std::vector<std::string> build_environment(const std::string& wayland_display,
+        const std::vector<std::string>& env)
+{
+    std::map<std::string, std::string> vars;
+    auto add = [&] (const std::string& entry)
+    {
+        auto eq = entry.find('=');
+        if (eq != std::string::npos)
+            vars[entry.substr(0, eq)] = entry;
+    };
+
+    for (char **e = environ; e && *e; e++)
+        add(*e);
+
+    add("WAYLAND_DISPLAY=" + wayland_display);
+    for (auto& entry : env)
+        add(entry);
+
+    std::vector<std::string> result;
+    for (auto& var : vars)
+        result.push_back(var.second);
+
+    return result;
+}
+
+pid_t wayfire_core::run(const char *command, const std::vector<std::string>& env)
+{
+    auto start = launch_clock::now();
+
+    auto environment = build_environment(wayland_display, env);
+    std::vector<char*> envp;
+    for (auto& entry : environment)
+        envp.push_back(&entry[0]);
+    envp.push_back(NULL);
+
+    /* signals handled by the event loop are blocked in the compositor */
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    const char *argv[] = {"/bin/sh", "-c", command, NULL};
+
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, (char* const*) argv, envp.data());
+    posix_spawnattr_destroy(&attr);
+
+    if (err)
+    {
+        errio << "launcher: failed to run \"" << command << "\": " << strerror(err) << std::endl;
+        return -1;
+    }
+
+    auto& child = children[pid];
+    child.command = command;
+    child.start = start;
+
+    if (log_launch_stats)
+    {
+        using namespace std::chrono;
+        auto us = duration_cast<microseconds>(launch_clock::now() - start).count();
+        info << "launcher: started \"" << command << "\" (" << pid << ") in "
+            << us << "us" << std::endl;
+    }
+
+    return pid;
+}
+
+void wayfire_core::report_view_created(pid_t pid)
+{
+    if (!log_launch_stats)
+        return;
+
+    auto it = children.find(pid);
+    if (it == children.end() || it->second.command.empty() || it->second.view_reported)
+        return;
+
+    it->second.view_reported = true;
+    info << "launcher: \"" << it->second.command << "\" (" << pid << ") created its first "
+        << "view after " << msec_since(it->second.start) << "ms" << std::endl;
+}
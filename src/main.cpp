@@ -60,10 +60,9 @@ int main(int argc, char *argv[]) {
     std::string home_dir = secure_getenv("HOME");
     debug << "Using home directory: " << home_dir << std::endl;
 
-    wayfire_config *config = new wayfire_config(home_dir + "/.config/wayfire.ini", -1);
+    wayfire_config *config = new wayfire_config(home_dir + "/.config/wayfire.ini");
     ec->repaint_msec = config->get_section("core")->get_int("repaint_msec", 16);
     ec->idle_time = config->get_section("core")->get_int("idle_time", 300);
-    config->set_refresh_rate(1000 / ec->repaint_msec);
     device_config::load(config);
 
     core = new wayfire_core();
@@ -109,7 +108,7 @@ int main(int argc, char *argv[]) {
     setenv("WAYLAND_SERVER", server_name, 1);
     core->wayland_display = server_name;
 
-    load_xwayland(ec);
+    load_xwayland(ec, config);
 
     desktop_api.struct_size = sizeof(weston_desktop_api);
     desktop_api.surface_added = desktop_surface_added;
@@ -386,17 +386,45 @@ void render_manager::render_panels()
     }
 }
 
+static int64_t timespec_to_msec(const timespec& ts)
+{
+    return ts.tv_sec * 1000ll + ts.tv_nsec / 1000000;
+}
+
+/* the next frame is shown one refresh after the last presented one,
+ * unless the output was idle or the last frame was late */
+int64_t render_manager::predict_frame_time()
+{
+    timespec now;
+    weston_compositor_read_presentation_clock(core->ec, &now);
+
+    int64_t refresh = core->ec->repaint_msec;
+    auto mode = output->handle->current_mode;
+    if (mode && mode->refresh > 0)
+        refresh = 1000000 / mode->refresh;
+
+    return std::max(timespec_to_msec(now),
+            timespec_to_msec(output->handle->frame_time) + refresh);
+}
+
+int64_t render_manager::get_frame_time()
+{
+    return in_repaint ? frame_time : predict_frame_time();
+}
+
 bool render_manager::paint(pixman_region32_t *damage)
 {
+    frame_time = predict_frame_time();
+    in_repaint = true;
+
     if (dirty_context)
         load_context();
 
+    pixman_region32_copy(&frame_damage, damage);
+    pixman_region32_subtract(&frame_damage, &frame_damage, &single_pixel);
+
     if (streams_running || renderer)
-    {
-        pixman_region32_copy(&frame_damage, damage);
-        pixman_region32_subtract(&frame_damage, &frame_damage, &single_pixel);
         update_full_damage_tracking();
-    }
 
     if (renderer)
     {
@@ -407,11 +435,29 @@ bool render_manager::paint(pixman_region32_t *damage)
         frame_was_custom_rendered = 1;
         OpenGL::bind_context(ctx);
         renderer();
-        return true;
     } else {
         frame_was_custom_rendered = 0;
-        return false;
+        OpenGL::bind_context(ctx);
+        render_builtin_background(damage);
     }
+
+    return frame_was_custom_rendered;
+}
+
+/* damage is the region weston repaints in this buffer, in global coordinates */
+void render_manager::render_builtin_background(pixman_region32_t *damage)
+{
+    if (!output->workspace)
+        return;
+
+    pixman_region32_t total;
+    pixman_region32_init(&total);
+    pixman_region32_copy(&total, damage);
+    pixman_region32_translate(&total, -output->handle->x, -output->handle->y);
+
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    output->workspace->render_background(&total, TEXTURE_TRANSFORM_USE_DEVCOORD);
+    pixman_region32_fini(&total);
 }
 
 void idle_full_redraw_cb(void *data)
@@ -428,6 +474,12 @@ void render_manager::post_paint()
     if (frame_was_custom_rendered && draw_overlay_panel)
         render_panels();
 
+    std::vector<effect_hook_t*> hooks = post_paint_hooks;
+    for (auto hook : hooks)
+        (*hook)();
+
+    core->input->output_frame_done(output);
+
     if (constant_redraw)
         schedule_redraw();
 
@@ -442,6 +494,8 @@ void render_manager::post_paint()
 
         dirty_renderer = false;
     }
+
+    in_repaint = false;
 }
 
 void render_manager::run_effects()
@@ -462,6 +516,7 @@ void render_manager::transformation_renderer()
     OpenGL::use_device_viewport();
     GL_CALL(glClearColor(1, 0, 0, 1));
     GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+    output->workspace->render_background(nullptr, TEXTURE_TRANSFORM_USE_DEVCOORD);
 
     auto it = views.rbegin();
     while (it != views.rend())
@@ -511,6 +566,29 @@ void render_manager::rem_effect(const effect_hook_t *hook, wayfire_view v)
     }
 }
 
+void render_manager::add_post_paint_hook(effect_hook_t *hook)
+{
+    post_paint_hooks.push_back(hook);
+}
+
+void render_manager::rem_post_paint_hook(const effect_hook_t *hook)
+{
+    auto it = std::find(post_paint_hooks.begin(), post_paint_hooks.end(), hook);
+    if (it != post_paint_hooks.end())
+        post_paint_hooks.erase(it);
+}
+
+void render_manager::get_frame_damage(pixman_region32_t *out_damage)
+{
+    /* custom renderers repaint the whole output */
+    if (frame_was_custom_rendered)
+        pixman_region32_copy(out_damage, &output->handle->region);
+    else
+        pixman_region32_copy(out_damage, &frame_damage);
+
+    pixman_region32_translate(out_damage, -output->handle->x, -output->handle->y);
+}
+
 void render_manager::texture_from_workspace(std::tuple<int, int> vp,
         GLuint &fbuff, GLuint &tex)
 {
@@ -529,6 +607,8 @@ void render_manager::texture_from_workspace(std::tuple<int, int> vp,
     int dx = -g.x + (cx - x)  * output->handle->width,
         dy = -g.y + (cy - y)  * output->handle->height;
 
+    output->workspace->render_background(nullptr, 0);
+
     auto views = output->workspace->get_renderable_views_on_workspace(vp);
     auto it = views.rbegin();
 
@@ -579,6 +659,8 @@ void render_manager::workspace_stream_start(wf_workspace_stream *stream)
     int dx = (cx - x)  * output->handle->width,
         dy = (cy - y)  * output->handle->height;
 
+    output->workspace->render_background(nullptr, 0);
+
     auto views = output->workspace->get_renderable_views_on_workspace(stream->ws);
     auto it = views.rbegin();
 
@@ -706,6 +788,13 @@ void render_manager::workspace_stream_update(wf_workspace_stream *stream,
     std::swap(wayfire_view_transform::global_scale, scale);
     std::swap(wayfire_view_transform::global_translate, translate);
 
+    /* what is left of the damage isn't covered by opaque views */
+    if (pixman_region32_not_empty(&ws_damage))
+    {
+        pixman_region32_translate(&ws_damage, -dx, -dy);
+        output->workspace->render_background(&ws_damage, 0);
+    }
+
     auto rev_it = update_views.rbegin();
     while(rev_it != update_views.rend())
     {
@@ -845,6 +934,23 @@ void shell_configure_panel(struct wl_client *client, struct wl_resource *resourc
     wo->workspace->configure_panel(view, x, y);
 }
 
+void shell_animate_panel(struct wl_client *client, struct wl_resource *resource,
+        uint32_t output, struct wl_resource *surface, int32_t x, int32_t y,
+        uint32_t duration, uint32_t curve)
+{
+    weston_surface *wsurf = (weston_surface*) wl_resource_get_user_data(surface);
+    wayfire_view view = (wsurf ? core->find_view(wsurf) : nullptr);
+    auto wo = wl_output_to_wayfire_output(output);
+    if (!wo) wo = view ? view->output : nullptr;
+
+    if (!wo || !view) {
+        errio << "shell_animate_panel called with invalid surface or output" << std::endl;
+        return;
+    }
+
+    wo->workspace->animate_panel(view, x, y, duration, curve);
+}
+
 void shell_reserve(struct wl_client *client, struct wl_resource *resource,
         uint32_t output, uint32_t side, uint32_t width, uint32_t height)
 {
@@ -900,7 +1006,8 @@ const struct wayfire_shell_interface shell_interface_impl {
     .configure_panel = shell_configure_panel,
     .reserve = shell_reserve,
     .set_color_gamma = shell_set_color_gamma,
-    .output_fade_in_start = shell_output_fade_in_start
+    .output_fade_in_start = shell_output_fade_in_start,
+    .animate_panel = shell_animate_panel
 };
 
 wayfire_output::wayfire_output(weston_output *handle, wayfire_config *c)
@@ -1199,6 +1306,15 @@ bool wayfire_output::is_plugin_active(owner_t name)
     return false;
 }
 
+bool wayfire_output::is_other_plugin_active(wayfire_grab_interface owner)
+{
+    for (auto act : active_plugins)
+        if (act && act != owner)
+            return true;
+
+    return false;
+}
+
 wayfire_grab_interface wayfire_output::get_input_grab_interface()
 {
     for (auto p : active_plugins)
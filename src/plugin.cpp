@@ -1,6 +1,5 @@
 #include "core.hpp"
 #include "output.hpp"
-#include <cmath>
 #include "input-manager.hpp"
 
 bool wayfire_grab_interface_t::grab()
@@ -41,15 +40,3 @@ bool wayfire_grab_interface_t::is_grabbed()
 }
 
 void wayfire_plugin_t::fini() {}
-
-const float MPI = 3.1415926535;
-
-float GetProgress(float start, float end, float current_step, float max_steps)
-{
-    if (max_steps <= 1e-4)
-        return end;
-
-    float c = current_step / max_steps;
-    float prog = std::sqrt(2 * c - c * c);
-    return prog * end + (1 - prog) * start;
-}
@@ -0,0 +1,205 @@
+#include "thread-pool.hpp"
+#include "debug.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct worker_queue
+    {
+        std::mutex lock;
+        std::deque<wf_thread_pool::task_t> tasks;
+    };
+
+    /* the index of the current thread's queue, -1 if it isn't a worker */
+    thread_local int current_worker = -1;
+}
+
+struct wf_thread_pool::impl
+{
+    std::once_flag started;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<worker_queue>> queues;
+
+    /* workers sleep on this when all queues are empty */
+    std::mutex sleep_lock;
+    std::condition_variable wakeup;
+    std::atomic<int> queued{0};
+    std::atomic<size_t> next_queue{0};
+
+    size_t nworkers;
+
+    impl()
+    {
+        /* the thread which submits the jobs(usually the compositor) works too */
+        unsigned hw = std::thread::hardware_concurrency();
+        nworkers = hw > 2 ? hw - 1 : 1;
+        for (size_t i = 0; i < nworkers; i++)
+            queues.emplace_back(new worker_queue);
+    }
+
+    void start()
+    {
+        std::call_once(started, [=] ()
+        {
+            debug << "starting " << nworkers << " worker threads" << std::endl;
+            for (size_t i = 0; i < nworkers; i++)
+                threads.emplace_back([=] () { worker_loop(i); });
+
+            /* we rely on the OS to clean up our threads */
+            for (auto& t : threads)
+                t.detach();
+        });
+    }
+
+    void push(task_t task)
+    {
+        /* workers push to their own queue, others spread the jobs */
+        size_t idx = current_worker >= 0 ? current_worker :
+            next_queue++ % nworkers;
+
+        auto& q = *queues[idx];
+        q.lock.lock();
+        q.tasks.push_back(std::move(task));
+        q.lock.unlock();
+
+        std::lock_guard<std::mutex> lock(sleep_lock);
+        ++queued;
+        wakeup.notify_one();
+    }
+
+    /* the worker takes the newest job of its own queue, which is the most
+     * likely to be in the cache, and steals the oldest ones of the others */
+    bool pop(size_t self, task_t& task)
+    {
+        for (size_t i = 0; i < nworkers; i++)
+        {
+            size_t idx = (self + i) % nworkers;
+            auto& q = *queues[idx];
+
+            std::lock_guard<std::mutex> lock(q.lock);
+            if (q.tasks.empty())
+                continue;
+
+            if (idx == self)
+            {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+
+            --queued;
+            return true;
+        }
+
+        return false;
+    }
+
+    void worker_loop(size_t self)
+    {
+        current_worker = self;
+
+        while (true)
+        {
+            task_t task;
+            if (pop(self, task))
+            {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_lock);
+            wakeup.wait(lock, [=] () { return queued > 0; });
+        }
+    }
+};
+
+wf_thread_pool::wf_thread_pool() : priv(new impl) {}
+wf_thread_pool::~wf_thread_pool() {}
+
+size_t wf_thread_pool::size()
+{
+    return priv->nworkers;
+}
+
+void wf_thread_pool::submit(task_t task)
+{
+    priv->start();
+    priv->push(std::move(task));
+}
+
+namespace
+{
+    /* shared with the helper jobs, which can run after parallel_for() returns */
+    struct range_job
+    {
+        size_t begin, end, chunk, nchunks;
+        const wf_thread_pool::range_task_t *task;
+
+        std::atomic<size_t> next_chunk{0};
+        std::atomic<size_t> done_chunks{0};
+
+        std::mutex lock;
+        std::condition_variable finished;
+
+        /* claims and runs chunks until there are none left */
+        void run()
+        {
+            size_t i;
+            while ((i = next_chunk++) < nchunks)
+            {
+                size_t start = begin + i * chunk;
+                (*task)(start, std::min(start + chunk, end));
+
+                if (++done_chunks == nchunks)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+}
+
+void wf_thread_pool::parallel_for(size_t begin, size_t end, size_t min_chunk,
+        const range_task_t& task)
+{
+    if (begin >= end)
+        return;
+
+    size_t n = end - begin;
+    size_t nthreads = size() + 1;
+    size_t chunk = std::max(std::max(min_chunk, (size_t)1), (n + nthreads - 1) / nthreads);
+    size_t nchunks = (n + chunk - 1) / chunk;
+
+    if (nchunks == 1)
+        return task(begin, end);
+
+    auto job = std::make_shared<range_job>();
+    job->begin = begin;
+    job->end = end;
+    job->chunk = chunk;
+    job->nchunks = nchunks;
+    job->task = &task;
+
+    priv->start();
+
+    /* the helpers which start after all chunks are claimed return right away,
+     * so task isn't used after we return */
+    for (size_t i = 0; i < std::min(nchunks - 1, size()); i++)
+        priv->push([job] () { job->run(); });
+
+    job->run();
+
+    std::unique_lock<std::mutex> lock(job->lock);
+    job->finished.wait(lock, [&] () { return job->done_chunks == job->nchunks; });
+}
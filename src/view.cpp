@@ -7,6 +7,8 @@
 #include "render-manager.hpp"
 
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
 #include "signal-definitions.hpp"
 
 #include <xwayland-api.h>
@@ -93,11 +95,11 @@ wayfire_view_t::wayfire_view_t(weston_desktop_surface *ds)
 
 wayfire_view_t::~wayfire_view_t()
 {
-    if (source_resize_plus)
-        wl_event_source_remove(source_resize_plus);
+    if (source_sync_position)
+        wl_event_source_remove(source_sync_position);
 
-    if (source_resize_minus)
-        wl_event_source_remove(source_resize_minus);
+    if (configure.timeout)
+        wl_event_source_remove(configure.timeout);
 
     for (auto& kv : custom_data)
         delete kv.second;
@@ -111,52 +113,34 @@ bool wayfire_view_t::is_visible()
     return true;
 }
 
-void idle_resize_minus(void *data)
+void idle_sync_xwayland_position(void *data)
 {
     auto view = static_cast<wayfire_view_t*> (data);
     assert(view);
 
-    if (view->desktop_surface && !view->destroyed)
+    /* a configure in flight carries the position already */
+    if (view->desktop_surface && !view->destroyed && !view->configure.waiting)
     {
         weston_desktop_surface_set_size(view->desktop_surface,
                                         view->geometry.width, view->geometry.height);
-
     }
 
-    view->source_resize_minus = NULL;
-}
-
-void idle_resize_plus(void *data)
-{
-    auto view = static_cast<wayfire_view_t*> (data);
-    assert(view);
-
-    if (view->desktop_surface && !view->destroyed && !view->source_resize_minus)
-    {
-        weston_desktop_surface_set_size(view->desktop_surface,
-                                        view->geometry.width - 1, view->geometry.height);
-
-        auto loop = wl_display_get_event_loop(core->ec->wl_display);
-        view->source_resize_minus = wl_event_loop_add_idle(loop,
-                                                           idle_resize_minus,
-                                                           data);
-    }
-
-    view->source_resize_plus = NULL;
+    view->source_sync_position = NULL;
 }
 
 /* To properly position override-redirect windows (such as menus),
- * the xwayland apps need to know their position on screen. However, due
- * to the way weston's window-manager works, the app receives such events
- * only when it is resized. That's why we force a resize at the end
- * of each continuous move(to avoid unnecessary resizes at each coordinate change */
+ * the xwayland apps need to know their position on screen. send_position()
+ * moves only the frame window, the app learns its position from the synthetic
+ * ConfigureNotify which weston's window manager sends with each configure.
+ * So at the end of each continuous move(and once per batch of other moves)
+ * the view is configured with its current size */
 void wayfire_view_t::force_update_xwayland_position()
 {
-    if (!source_resize_plus && !source_resize_minus)
+    if (!source_sync_position)
     {
         auto loop = wl_display_get_event_loop(core->ec->wl_display);
-        source_resize_plus = wl_event_loop_add_idle(loop,
-                                                    idle_resize_plus, this);
+        source_sync_position = wl_event_loop_add_idle(loop,
+                                                      idle_sync_xwayland_position, this);
     }
 }
 
@@ -171,9 +155,123 @@ void wayfire_view_t::set_moving(bool moving)
 void wayfire_view_t::set_resizing(bool resizing)
 {
     in_continuous_resize += resizing ? 1 : -1;
+
+    if (!in_continuous_resize)
+    {
+        if (configure.timeout)
+            wl_event_source_remove(configure.timeout);
+        configure.timeout = NULL;
+        configure.waiting = false;
+
+        if (configure.has_pending)
+        {
+            configure.has_pending = false;
+            set_geometry(configure.pending);
+        }
+
+        log_configure_stats();
+    }
+
     weston_desktop_surface_set_resizing(desktop_surface, resizing);
 }
 
+static int64_t get_time_msec()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/* if the client doesn't answer(for ex. because it is hung or it can't take
+ * a size different than the current one), the next size is sent anyway */
+static const int configure_timeout_ms = 100;
+
+int configure_timeout(void *data)
+{
+    auto view = static_cast<wayfire_view_t*> (data);
+
+    /* timers aren't removed when they fire */
+    wl_event_source_remove(view->configure.timeout);
+    view->configure.timeout = NULL;
+    view->configure_answered();
+
+    return 0;
+}
+
+void wayfire_view_t::configure_sent(int w, int h)
+{
+    if (!in_continuous_resize || (w == geometry.width && h == geometry.height))
+        return;
+
+    configure.waiting = true;
+    configure.sent_width = w;
+    configure.sent_height = h;
+    /* geometry already has the size of the last configure, the client
+     * may not have committed it yet(for ex. if the last one timed out) */
+    auto committed = weston_desktop_surface_get_geometry(desktop_surface);
+    configure.old_width = committed.width;
+    configure.old_height = committed.height;
+    configure.sent_time = get_time_msec();
+    configure.sent++;
+
+    auto loop = wl_display_get_event_loop(core->ec->wl_display);
+    if (!configure.timeout)
+        configure.timeout = wl_event_loop_add_timer(loop, configure_timeout, this);
+    wl_event_source_timer_update(configure.timeout, configure_timeout_ms);
+}
+
+/* libweston-desktop doesn't tell us which configure the client has acked,
+ * so a commit which changes the size(or has exactly the size we sent)
+ * is considered to be the answer */
+void wayfire_view_t::check_configure_answered()
+{
+    if (!configure.waiting)
+        return;
+
+    bool same_as_sent = geometry.width == configure.sent_width &&
+        geometry.height == configure.sent_height;
+    bool same_as_old = geometry.width == configure.old_width &&
+        geometry.height == configure.old_height;
+
+    if (same_as_sent || !same_as_old)
+    {
+        if (configure.timeout)
+            wl_event_source_remove(configure.timeout);
+        configure.timeout = NULL;
+
+        configure_answered();
+    }
+}
+
+void wayfire_view_t::configure_answered()
+{
+    if (!configure.waiting)
+        return;
+
+    auto lag = get_time_msec() - configure.sent_time;
+    configure.total_lag += lag;
+    configure.max_lag = std::max(configure.max_lag, lag);
+    configure.waiting = false;
+
+    if (configure.has_pending && !destroyed)
+    {
+        configure.has_pending = false;
+        set_geometry(configure.pending);
+    }
+}
+
+void wayfire_view_t::log_configure_stats()
+{
+    if (configure.sent)
+    {
+        debug << "resize of view " << this << ": " << configure.sent
+            << " configures sent, " << configure.coalesced << " sizes coalesced, "
+            << "client lag avg " << configure.total_lag / configure.sent
+            << "ms max " << configure.max_lag << "ms" << std::endl;
+    }
+
+    configure.sent = configure.coalesced = 0;
+    configure.total_lag = configure.max_lag = 0;
+}
 
 void wayfire_view_t::move(int x, int y, bool send_signal)
 {
@@ -198,10 +296,17 @@ void wayfire_view_t::move(int x, int y, bool send_signal)
 
 void wayfire_view_t::resize(int w, int h, bool send_signal)
 {
+    if (configure.waiting)
+    {
+        set_geometry(geometry.x, geometry.y, w, h);
+        return;
+    }
+
     view_geometry_changed_signal data;
     data.view = core->find_view(handle);
     data.old_geometry = geometry;
 
+    configure_sent(w, h);
     weston_desktop_surface_set_size(desktop_surface, w, h);
     geometry.width = w;
     geometry.height = h;
@@ -212,14 +317,22 @@ void wayfire_view_t::resize(int w, int h, bool send_signal)
 
 void wayfire_view_t::set_geometry(weston_geometry g)
 {
+    /* the position is delayed too, so that it matches the size */
+    if (configure.waiting)
+    {
+        configure.coalesced += configure.has_pending;
+        configure.has_pending = true;
+        configure.pending = g;
+        return;
+    }
+
     move(g.x, g.y, false);
     resize(g.width, g.height);
 }
 
 void wayfire_view_t::set_geometry(int x, int y, int w, int h)
 {
-    move(x, y, false);
-    resize(w, h);
+    set_geometry({x, y, w, h});
 }
 
 void wayfire_view_t::set_maximized(bool maxim)
@@ -281,6 +394,8 @@ void wayfire_view_t::map(int sx, int sy)
             geometry.y = sy;
         }
 
+        update_title(false);
+
         weston_view_update_transform(handle);
         handle->is_mapped  = true;
         surface->is_mapped = true;
@@ -311,13 +426,31 @@ void wayfire_view_t::map(int sx, int sy)
     }
 
     auto new_ds_g = weston_desktop_surface_get_geometry(desktop_surface);
+    bool size_changed = new_ds_g.width != ds_geometry.width ||
+        new_ds_g.height != ds_geometry.height;
+
     if (new_ds_g.x != ds_geometry.x || new_ds_g.y != ds_geometry.y) {
         ds_geometry = new_ds_g;
         move(geometry.x, geometry.y);
     }
 
+    auto old_geometry = geometry;
+    ds_geometry.width = new_ds_g.width;
+    ds_geometry.height = new_ds_g.height;
     geometry.width = new_ds_g.width;
     geometry.height = new_ds_g.height;
+    check_configure_answered();
+
+    /* the client has committed a buffer with a new size */
+    if (size_changed)
+    {
+        view_geometry_changed_signal data;
+        data.view = core->find_view(handle);
+        data.old_geometry = old_geometry;
+        output->emit_signal("view-size-committed", &data);
+    }
+
+    update_title(true);
 
     auto full  = weston_desktop_surface_get_fullscreen(desktop_surface),
          maxim = weston_desktop_surface_get_maximized(desktop_surface);
@@ -341,6 +474,28 @@ void wayfire_view_t::map(int sx, int sy)
     }
 }
 
+void wayfire_view_t::update_title(bool send_signal)
+{
+    auto title = weston_desktop_surface_get_title(desktop_surface);
+    auto app_id = weston_desktop_surface_get_app_id(desktop_surface);
+    if (!title) title = "";
+    if (!app_id) app_id = "";
+
+    /* compared without copying, this runs on every commit */
+    if (last_title == title && last_app_id == app_id)
+        return;
+
+    last_title = title;
+    last_app_id = app_id;
+
+    if (send_signal)
+    {
+        view_title_changed_signal data;
+        data.view = core->find_view(handle);
+        output->emit_signal("view-title-changed", &data);
+    }
+}
+
 static void render_surface(weston_surface *surface, pixman_region32_t *damage,
         int x, int y, glm::mat4, glm::vec4, uint32_t bits);
 
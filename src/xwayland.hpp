@@ -5,25 +5,62 @@
 #include <xwayland-api.h>
 #include "debug.hpp"
 #include "core.hpp"
+#include "view.hpp"
+#include "../shared/config.hpp"
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <signal.h>
+#include <unistd.h>
 #include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+/* lazy: the X server is started when the first X client connects
+ * prewarm: it is started in the background shortly after startup
+ * idle_exit: it is started lazily and stopped after a while without X clients */
+enum xwayland_mode_t
+{
+    XWAYLAND_LAZY,
+    XWAYLAND_PREWARM,
+    XWAYLAND_IDLE_EXIT
+};
 
 struct xwayland_t {
     const weston_xwayland_api *api;
     weston_xwayland* handle;
+    const weston_xwayland_surface_api *surface_api;
 
-    wl_event_source *sigusr1;
+    wl_event_source *sigusr1 = NULL;
     wl_client *client;
     int fd;
+
+    xwayland_mode_t mode = XWAYLAND_LAZY;
+    pid_t pid = 0;
+
+    /* the prewarm timer or the idle exit timer, depending on mode */
+    wl_event_source *timer = NULL;
+    int prewarm_delay, idle_timeout;
+
+    int num_views = 0;
 } xwayland;
 
 int handle_sigusr1(int ignore, void *data) {
     xwayland.api->xserver_loaded(xwayland.handle, xwayland.client, xwayland.fd);
     wl_event_source_remove(xwayland.sigusr1);
+    xwayland.sigusr1 = NULL;
     return 0;
 }
 
+/* weston listens again on the X display after the server has exited,
+ * so the next X client starts it again */
+void xwayland_exited(int status)
+{
+    info << "Xwayland exited with status " << status << std::endl;
+    xwayland.pid = 0;
+    xwayland.api->xserver_exited(xwayland.handle, status);
+}
+
 pid_t spawn_callback(void *data, const char *display, int abstract_fd, int unix_fd) {
     info << "Xwayland display: " << display << std::endl;
 
@@ -42,6 +79,11 @@ pid_t spawn_callback(void *data, const char *display, int abstract_fd, int unix_
 
     int pid = fork();
     if (pid == 0) {
+        /* signals handled by the event loop are blocked in the compositor */
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
         int fd = dup(sv[1]);
         setenv("WAYLAND_SOCKET", std::to_string(fd).c_str(), 1);
 
@@ -70,12 +112,131 @@ pid_t spawn_callback(void *data, const char *display, int abstract_fd, int unix_
         xwayland.client = wl_client_create(core->ec->wl_display, sv[0]);
         close(wm[1]);
         xwayland.fd = wm[0];
+        xwayland.pid = pid;
+        core->watch_child(pid, xwayland_exited);
+
+        auto loop = wl_display_get_event_loop(core->ec->wl_display);
+        if (!xwayland.sigusr1)
+            xwayland.sigusr1 = wl_event_loop_add_signal(loop, SIGUSR1, handle_sigusr1, NULL);
+
+        /* X clients which never map a window shouldn't keep it running */
+        if (xwayland.mode == XWAYLAND_IDLE_EXIT && xwayland.num_views == 0)
+            wl_event_source_timer_update(xwayland.timer, xwayland.idle_timeout);
     }
 
     return pid;
 }
 
-int load_xwayland(weston_compositor *ec) {
+/* connecting to the X display makes weston start the server,
+ * the connection is closed right away */
+static int prewarm_xwayland(void *data)
+{
+    wl_event_source_remove(xwayland.timer);
+    xwayland.timer = NULL;
+
+    if (xwayland.pid > 0 || core->xwayland_display.size() < 2)
+        return 0;
+
+    sockaddr_un addr;
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/.X11-unix/X%s",
+            core->xwayland_display.c_str() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return 0;
+
+    if (connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+        errio << "Failed to prewarm Xwayland" << std::endl;
+    else
+        debug << "prewarming Xwayland" << std::endl;
+
+    close(fd);
+    return 0;
+}
+
+/* Clients without windows(xsettingsd, clipboard managers...) don't show up as
+ * views, so the connections to the X socket are counted instead. The sockets
+ * accepted by the server carry the path of the listening socket in
+ * /proc/net/unix, the connection to weston's window manager is a socketpair */
+static int count_x_clients()
+{
+    std::ifstream in("/proc/net/unix");
+    if (!in || core->xwayland_display.size() < 2)
+        return -1;
+
+    std::string path = "/tmp/.X11-unix/X" + core->xwayland_display.substr(1);
+
+    int count = 0;
+    std::string line;
+    std::getline(in, line); /* header */
+    while (std::getline(in, line))
+    {
+        /* Num RefCount Protocol Flags Type St Inode Path */
+        std::istringstream fields(line);
+        std::string num, refcount, protocol, flags, type, state, inode, name;
+        fields >> num >> refcount >> protocol >> flags >> type >> state >> inode >> name;
+
+        /* 03 is SS_CONNECTED, abstract sockets start with @ */
+        if (state == "03" && (name == path || name == "@" + path))
+            ++count;
+    }
+
+    return count;
+}
+
+static int idle_exit_xwayland(void *data)
+{
+    if (xwayland.pid <= 0 || xwayland.num_views > 0)
+        return 0;
+
+    int clients = count_x_clients();
+    if (clients != 0)
+    {
+        /* check again later, if we can't tell, better keep the server */
+        wl_event_source_timer_update(xwayland.timer, xwayland.idle_timeout);
+        return 0;
+    }
+
+    info << "stopping idle Xwayland" << std::endl;
+    kill(xwayland.pid, SIGTERM);
+
+    return 0;
+}
+
+/* called for each view, they are used to find out when the X server is idle */
+void xwayland_view_added(wayfire_view view)
+{
+    if (!xwayland.surface_api || !xwayland.surface_api->is_xwayland_surface(view->surface))
+        return;
+
+    ++xwayland.num_views;
+    if (xwayland.timer && xwayland.mode == XWAYLAND_IDLE_EXIT)
+        wl_event_source_timer_update(xwayland.timer, 0);
+}
+
+void xwayland_view_removed(wayfire_view view)
+{
+    if (!xwayland.surface_api || !xwayland.surface_api->is_xwayland_surface(view->surface))
+        return;
+
+    if (--xwayland.num_views == 0 && xwayland.timer && xwayland.mode == XWAYLAND_IDLE_EXIT)
+        wl_event_source_timer_update(xwayland.timer, xwayland.idle_timeout);
+}
+
+int load_xwayland(weston_compositor *ec, wayfire_config *config) {
+    auto section = config->get_section("core");
+    auto mode = section->get_string("xwayland_mode", "lazy");
+    if (mode == "prewarm")
+        xwayland.mode = XWAYLAND_PREWARM;
+    else if (mode == "idle_exit")
+        xwayland.mode = XWAYLAND_IDLE_EXIT;
+    else if (mode != "lazy")
+        errio << "Unknown xwayland_mode " << mode << ", using lazy" << std::endl;
+
+    xwayland.prewarm_delay = section->get_duration("xwayland_prewarm_delay", 2000);
+    xwayland.idle_timeout = 1000 * section->get_int("xwayland_idle_timeout", 60);
+
     if (weston_compositor_load_xwayland(ec) < 0)
         return -1;
 
@@ -92,8 +253,24 @@ int load_xwayland(weston_compositor *ec) {
         return -1;
     }
 
+    xwayland.surface_api = weston_xwayland_surface_get_api(ec);
+
+    /* weston sets DISPLAY when it starts listening */
+    if (getenv("DISPLAY"))
+        core->xwayland_display = getenv("DISPLAY");
+
     auto loop = wl_display_get_event_loop(core->ec->wl_display);
     xwayland.sigusr1 = wl_event_loop_add_signal(loop, SIGUSR1, handle_sigusr1, NULL);
+
+    if (xwayland.mode == XWAYLAND_PREWARM)
+    {
+        xwayland.timer = wl_event_loop_add_timer(loop, prewarm_xwayland, NULL);
+        wl_event_source_timer_update(xwayland.timer, std::max(1, xwayland.prewarm_delay));
+    } else if (xwayland.mode == XWAYLAND_IDLE_EXIT)
+    {
+        xwayland.timer = wl_event_loop_add_timer(loop, idle_exit_xwayland, NULL);
+    }
+
     return 0;
 }
 